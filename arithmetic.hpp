@@ -0,0 +1,108 @@
+/*
+ * arithmetic.hpp
+ *
+ * Dyplo example application.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*  Sample arithmetic for int, int16_t and int8_t elements.
+ *
+ *  Additions are done in the element's own width, so that the block
+ *  functions below vectorize with as many lanes as fit in a register:
+ *  two or four times as many samples per instruction for 16- and 8-bit
+ *  elements compared to int. The saturating variant detects overflow from
+ *  the signs instead of computing in a wider type, which would otherwise
+ *  force the vectorizer to unpack to 32-bit lanes. The processes only
+ *  profit from this with a block size above 1 (option -k of the demo).
+ */
+#pragma once
+
+#include <stdint.h>
+#include <limits>
+
+template <class T> struct UnsignedSample { typedef unsigned int type; };
+template <> struct UnsignedSample<int16_t> { typedef uint16_t type; };
+template <> struct UnsignedSample<int8_t> { typedef uint8_t type; };
+
+/* Wraps around on overflow, like the hardware nodes do */
+template <class T> struct WrappingArithmetic
+{
+	typedef T Element;
+
+	static T convert(long long value)
+	{
+		return (T)value;
+	}
+
+	static T add(T a, T b)
+	{
+		typedef typename UnsignedSample<T>::type U;
+		return (T)(U)((U)a + (U)b);
+	}
+};
+
+/* Clamps to the range of T on overflow */
+template <class T> struct SaturatingArithmetic
+{
+	typedef T Element;
+
+	static T convert(long long value)
+	{
+		const long long lo = std::numeric_limits<T>::min();
+		const long long hi = std::numeric_limits<T>::max();
+		return (T)(value < lo ? lo : (value > hi ? hi : value));
+	}
+
+	static T add(T a, T b)
+	{
+		T sum = WrappingArithmetic<T>::add(a, b);
+		/* Overflow when both operands differ in sign from the result,
+		 * the limit then has the sign of the operands. */
+		T limit = (T)((a >> (sizeof(T) * 8 - 1)) ^ std::numeric_limits<T>::max());
+		return ((a ^ sum) & (b ^ sum)) < 0 ? limit : sum;
+	}
+};
+
+/* The buffers must not overlap. Telling the compiler so lets it
+ * vectorize without a runtime overlap check, which the default -O2 cost
+ * model of GCC won't emit. */
+template <class Arithmetic>
+inline void add_block(typename Arithmetic::Element* __restrict__ dest,
+	const typename Arithmetic::Element* __restrict__ left,
+	const typename Arithmetic::Element* __restrict__ right,
+	unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+		dest[i] = Arithmetic::add(left[i], right[i]);
+}
+
+template <class Arithmetic>
+inline void add_constant_block(typename Arithmetic::Element* __restrict__ dest,
+	const typename Arithmetic::Element* __restrict__ src,
+	typename Arithmetic::Element value,
+	unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+		dest[i] = Arithmetic::add(src[i], value);
+}
@@ -0,0 +1,277 @@
+/*
+ * coalescingqueue.hpp
+ *
+ * Dyplo example application.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*  Memory queue with the same interface as dyplo::FixedMemoryQueue, that
+ *  limits the number of wakeups between producer and consumer.
+ *
+ *  A consumer blocked on an empty queue is only woken once "watermark"
+ *  items are available, and a producer blocked on a full queue only once
+ *  "watermark" slots are free. To bound the latency, the blocked side
+ *  also continues "max_delay_us" after the first item (slot) became
+ *  available, with whatever is there by then. While there is nothing at
+ *  all, it sleeps without a timer, so an idle queue causes no wakeups.
+ *  With watermark 1 and no delay, this behaves like a plain queue.
+ */
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <stdexcept>
+#include "dyplo/thread.hpp"
+
+struct NotifyPolicy
+{
+	unsigned int watermark;
+	unsigned int max_delay_us;
+
+	NotifyPolicy(unsigned int watermark_ = 1, unsigned int max_delay_us_ = 0):
+		watermark(watermark_),
+		max_delay_us(max_delay_us_)
+	{
+	}
+};
+
+template <class T> class CoalescingQueue
+{
+	protected:
+		T* buffer;
+		unsigned int capacity;
+		unsigned int read_index;
+		unsigned int count;
+		NotifyPolicy policy;
+		/* Number of items (slots) at which the waiting reader (writer)
+		 * must be signalled, zero when it isn't waiting. */
+		unsigned int reader_wakeup_at;
+		unsigned int writer_wakeup_at;
+		bool interrupted_read;
+		bool interrupted_write;
+		pthread_mutex_t mutex;
+		/* Timeouts are measured on the monotonic clock */
+		pthread_cond_t not_empty;
+		pthread_cond_t not_full;
+	public:
+		typedef T Element;
+
+		CoalescingQueue(unsigned int capacity_, const NotifyPolicy& policy_ = NotifyPolicy()):
+			buffer(new T[capacity_]),
+			capacity(capacity_),
+			read_index(0),
+			count(0),
+			policy(policy_),
+			reader_wakeup_at(0),
+			writer_wakeup_at(0),
+			interrupted_read(false),
+			interrupted_write(false)
+		{
+			if (policy.watermark < 1)
+				policy.watermark = 1;
+			if (policy.watermark > capacity)
+				policy.watermark = capacity;
+			/* Without a timer, the last items of a stream would never
+			 * reach the consumer. */
+			if (policy.watermark > 1 && policy.max_delay_us == 0)
+			{
+				delete [] buffer;
+				throw std::invalid_argument("A watermark above 1 requires a maximum delay");
+			}
+			pthread_mutex_init(&mutex, NULL);
+			pthread_condattr_t attr;
+			pthread_condattr_init(&attr);
+			pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+			pthread_cond_init(&not_empty, &attr);
+			pthread_cond_init(&not_full, &attr);
+			pthread_condattr_destroy(&attr);
+		}
+
+		~CoalescingQueue()
+		{
+			pthread_cond_destroy(&not_full);
+			pthread_cond_destroy(&not_empty);
+			pthread_mutex_destroy(&mutex);
+			delete [] buffer;
+		}
+
+		unsigned int begin_read(T* &data, unsigned int wanted)
+		{
+			pthread_mutex_lock(&mutex);
+			if (count < wanted)
+				wait(not_empty, reader_wakeup_at, wanted, true);
+			bool interrupted = interrupted_read;
+			unsigned int result = capacity - read_index;
+			if (result > count)
+				result = count;
+			data = buffer + read_index;
+			pthread_mutex_unlock(&mutex);
+			if (interrupted)
+				throw dyplo::InterruptedException();
+			return result;
+		}
+
+		void end_read(unsigned int n)
+		{
+			pthread_mutex_lock(&mutex);
+			bool was_full = (count == capacity);
+			count -= n;
+			read_index += n;
+			if (read_index >= capacity)
+				read_index -= capacity;
+			if (must_wake(writer_wakeup_at, capacity - count, was_full))
+				pthread_cond_signal(&not_full);
+			pthread_mutex_unlock(&mutex);
+		}
+
+		unsigned int begin_write(T* &data, unsigned int wanted)
+		{
+			pthread_mutex_lock(&mutex);
+			if (capacity - count < wanted)
+				wait(not_full, writer_wakeup_at, wanted, false);
+			bool interrupted = interrupted_write;
+			unsigned int free_slots = capacity - count;
+			unsigned int write_index = read_index + count;
+			if (write_index >= capacity)
+				write_index -= capacity;
+			unsigned int result = capacity - write_index;
+			if (result > free_slots)
+				result = free_slots;
+			data = buffer + write_index;
+			pthread_mutex_unlock(&mutex);
+			if (interrupted)
+				throw dyplo::InterruptedException();
+			return result;
+		}
+
+		void end_write(unsigned int n)
+		{
+			pthread_mutex_lock(&mutex);
+			bool was_empty = (count == 0);
+			count += n;
+			if (must_wake(reader_wakeup_at, count, was_empty))
+				pthread_cond_signal(&not_empty);
+			pthread_mutex_unlock(&mutex);
+		}
+
+		void push_one(const T& value)
+		{
+			T* data;
+			begin_write(data, 1);
+			*data = value;
+			end_write(1);
+		}
+
+		T pop_one()
+		{
+			T* data;
+			begin_read(data, 1);
+			T result = *data;
+			end_read(1);
+			return result;
+		}
+
+		void interrupt_read()
+		{
+			pthread_mutex_lock(&mutex);
+			interrupted_read = true;
+			pthread_cond_broadcast(&not_empty);
+			pthread_mutex_unlock(&mutex);
+		}
+
+		void interrupt_write()
+		{
+			pthread_mutex_lock(&mutex);
+			interrupted_write = true;
+			pthread_cond_broadcast(&not_full);
+			pthread_mutex_unlock(&mutex);
+		}
+	private:
+		unsigned int wakeup_threshold(unsigned int wanted) const
+		{
+			return wanted > policy.watermark ? wanted : policy.watermark;
+		}
+
+		unsigned int available(bool reading) const
+		{
+			return reading ? count : capacity - count;
+		}
+
+		bool is_interrupted(bool reading) const
+		{
+			return reading ? interrupted_read : interrupted_write;
+		}
+
+		/* The waiting side wants a signal when the watermark is reached,
+		 * and, if it has a timer to start, when the first item (slot)
+		 * shows up. */
+		bool must_wake(unsigned int wakeup_at, unsigned int now_available, bool was_none) const
+		{
+			if (!wakeup_at)
+				return false;
+			return (now_available >= wakeup_at) ||
+				(was_none && policy.max_delay_us != 0);
+		}
+
+		/* Wait (with the mutex held) until "wanted" items or slots are
+		 * available. We hold out for the watermark, but no longer than
+		 * the maximum delay after the first item (slot) arrived, then
+		 * continue as soon as there's enough for this request. */
+		void wait(pthread_cond_t& condition, unsigned int& wakeup_at, unsigned int wanted, bool reading)
+		{
+			wakeup_at = wakeup_threshold(wanted);
+			bool timer_started = false;
+			bool timer_expired = false;
+			struct timespec deadline;
+			while ((available(reading) < wakeup_at) && !is_interrupted(reading))
+			{
+				if (policy.max_delay_us == 0 || available(reading) == 0 || timer_expired)
+				{
+					pthread_cond_wait(&condition, &mutex);
+					continue;
+				}
+				if (!timer_started)
+				{
+					clock_gettime(CLOCK_MONOTONIC, &deadline);
+					deadline.tv_sec += policy.max_delay_us / 1000000;
+					deadline.tv_nsec += (policy.max_delay_us % 1000000) * 1000L;
+					if (deadline.tv_nsec >= 1000000000L)
+					{
+						deadline.tv_sec += 1;
+						deadline.tv_nsec -= 1000000000L;
+					}
+					timer_started = true;
+				}
+				if (pthread_cond_timedwait(&condition, &mutex, &deadline) == ETIMEDOUT)
+				{
+					/* Settle for what this request needs, and have the
+					 * other side signal as soon as that is there. */
+					timer_expired = true;
+					wakeup_at = wanted;
+				}
+			}
+			wakeup_at = 0;
+		}
+};
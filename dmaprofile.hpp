@@ -0,0 +1,181 @@
+/*
+ * dmaprofile.hpp
+ *
+ * Dyplo example application.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*  DMA tuning profile, as written by dyplocalibratedma and read by the
+ *  DMA example applications at startup.
+ *
+ *  The file contains "key = value" lines, '#' starts a comment:
+ *
+ *    copy_block_bytes = 16384
+ *    copy_threshold_bytes = 16384
+ *    zerocopy_mode = coherent
+ *    zerocopy_block_bytes = 16384
+ *    zerocopy_blocks = 2
+ *
+ *  Missing keys keep their defaults, which are the values the examples
+ *  used before profiles existed.
+ */
+#pragma once
+
+#include <stdlib.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+/* Used when neither "-P" nor DYPLO_DMA_PROFILE in the environment specify
+ * another location */
+#define DYPLO_DMA_PROFILE_DEFAULT_PATH "/etc/dyplo-dma-profile.conf"
+
+struct DmaProfile
+{
+	enum Mode { COHERENT, STREAMING };
+
+	/* Copy mode (HardwareFifo) */
+	unsigned int copy_block_bytes;
+	unsigned int copy_threshold_bytes;
+	/* Zero-copy mode (HardwareDMAFifo) */
+	Mode zerocopy_mode;
+	unsigned int zerocopy_block_bytes;
+	unsigned int zerocopy_blocks;
+
+	DmaProfile():
+		copy_block_bytes(16384),
+		copy_threshold_bytes(16384),
+		zerocopy_mode(COHERENT),
+		zerocopy_block_bytes(16384),
+		zerocopy_blocks(2)
+	{
+	}
+
+	/* Location of the profile: "filename" if given, otherwise from the
+	 * environment or the default path */
+	static std::string path(const char* filename)
+	{
+		if (filename != NULL)
+			return filename;
+		const char* env = getenv("DYPLO_DMA_PROFILE");
+		if (env != NULL && *env)
+			return env;
+		return DYPLO_DMA_PROFILE_DEFAULT_PATH;
+	}
+
+	/* Returns false if the file does not exist, throws when it contains
+	 * invalid settings. */
+	bool load(const std::string& filename)
+	{
+		std::ifstream input(filename.c_str());
+		if (!input)
+			return false;
+		std::string line;
+		while (std::getline(input, line))
+		{
+			std::string::size_type hash = line.find('#');
+			if (hash != std::string::npos)
+				line.erase(hash);
+			std::string::size_type eq = line.find('=');
+			if (eq == std::string::npos)
+			{
+				if (line.find_first_not_of(" \t\r") != std::string::npos)
+					throw std::runtime_error(filename + ": invalid line: " + line);
+				continue;
+			}
+			set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), filename);
+		}
+		validate(filename);
+		return true;
+	}
+
+	void save(const std::string& filename) const
+	{
+		std::ofstream output(filename.c_str());
+		output <<
+			"# DMA profile, written by dyplocalibratedma\n"
+			"copy_block_bytes = " << copy_block_bytes << "\n"
+			"copy_threshold_bytes = " << copy_threshold_bytes << "\n"
+			"zerocopy_mode = " << (zerocopy_mode == STREAMING ? "streaming" : "coherent") << "\n"
+			"zerocopy_block_bytes = " << zerocopy_block_bytes << "\n"
+			"zerocopy_blocks = " << zerocopy_blocks << "\n";
+		output.close();
+		if (!output)
+			throw std::runtime_error("Failed to write " + filename);
+	}
+private:
+	static std::string trim(const std::string& text)
+	{
+		std::string::size_type begin = text.find_first_not_of(" \t\r");
+		if (begin == std::string::npos)
+			return std::string();
+		std::string::size_type end = text.find_last_not_of(" \t\r");
+		return text.substr(begin, end - begin + 1);
+	}
+
+	static unsigned int to_uint(const std::string& key, const std::string& value, const std::string& filename)
+	{
+		std::istringstream input(value);
+		unsigned int result;
+		if (!(input >> result) || !input.eof())
+			throw std::runtime_error(filename + ": invalid value for " + key + ": " + value);
+		return result;
+	}
+
+	void set(const std::string& key, const std::string& value, const std::string& filename)
+	{
+		if (key == "copy_block_bytes")
+			copy_block_bytes = to_uint(key, value, filename);
+		else if (key == "copy_threshold_bytes")
+			copy_threshold_bytes = to_uint(key, value, filename);
+		else if (key == "zerocopy_block_bytes")
+			zerocopy_block_bytes = to_uint(key, value, filename);
+		else if (key == "zerocopy_blocks")
+			zerocopy_blocks = to_uint(key, value, filename);
+		else if (key == "zerocopy_mode")
+		{
+			if (value == "coherent")
+				zerocopy_mode = COHERENT;
+			else if (value == "streaming")
+				zerocopy_mode = STREAMING;
+			else
+				throw std::runtime_error(filename + ": invalid value for " + key + ": " + value);
+		}
+		else
+			throw std::runtime_error(filename + ": unknown setting: " + key);
+	}
+
+	/* Blocks must hold whole 32-bit words, the threshold can't exceed
+	 * the block size */
+	void validate(const std::string& filename) const
+	{
+		if (copy_block_bytes == 0 || (copy_block_bytes % 4) ||
+			copy_threshold_bytes == 0 || (copy_threshold_bytes % 4) ||
+			copy_threshold_bytes > copy_block_bytes ||
+			zerocopy_block_bytes == 0 || (zerocopy_block_bytes % 4) ||
+			zerocopy_blocks == 0)
+			throw std::runtime_error(filename + ": inconsistent DMA settings");
+	}
+};
@@ -0,0 +1,559 @@
+/*
+ * dyplocalibratedma.cpp
+ *
+ * Finds DMA settings for the joining_adder example pipeline.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*
+ * This program runs the same pipeline as dyploexampledma and
+ * dyploexamplezdma with a range of block sizes, data thresholds (copy mode)
+ * and block counts and memory modes (zero-copy mode). For each combination
+ * it measures the throughput and the latency per block, and it stores the
+ * best settings in a profile that the DMA examples load at startup.
+ *
+ * "Best" is the highest throughput whose 99th percentile latency stays
+ * within the target given with "-l". Without a target, throughput alone
+ * decides.
+ *
+ * dyploexampledma writes a whole block to each input before reading the
+ * result, which only works if a block fits in the driver's copy-mode
+ * buffer. Copy-mode blocks are therefore limited to the buffer size given
+ * with "-b".
+ *
+ * With "-s", software stand-ins replace the FPGA and the DMA driver, so
+ * the calibration can be tried out on any Linux system.
+ */
+#include "dyplo/hardware.hpp"
+#include <unistd.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "dmaprofile.hpp"
+#include "testpattern.hpp"
+#include "loadgenerator.hpp"
+#include "softwaredma.hpp"
+
+static const unsigned int block_sizes[] =
+	{ 4096, 8192, 16384, 32768, 65536, 131072, 262144 };
+static const unsigned int threshold_divisors[] = { 1, 2, 4 };
+static const unsigned int block_counts[] = { 2, 3, 4, 8 };
+static const DmaProfile::Mode memory_modes[] =
+	{ DmaProfile::COHERENT, DmaProfile::STREAMING };
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Every run transfers at least this many blocks, to get a meaningful
+ * 99th percentile for the larger block sizes. */
+static const unsigned int min_blocks_per_run = 64;
+
+/* Result of one combination of settings */
+struct Measurement
+{
+	DmaProfile::Mode mode;
+	unsigned int block_bytes;
+	/* Data threshold (copy mode) or number of blocks (zero-copy mode) */
+	unsigned int setting;
+	double mb_per_second;
+	uint64_t p50_ns;
+	uint64_t p99_ns;
+};
+
+struct CalibrationOptions
+{
+	unsigned long long bytes_per_run;
+	unsigned int latency_target_us;
+	/* Size of the copy-mode DMA buffer in the driver */
+	unsigned int copy_buffer_bytes;
+
+	CalibrationOptions():
+		bytes_per_run(16ULL << 20),
+		latency_target_us(0),
+		copy_buffer_bytes(65536)
+	{
+	}
+
+	unsigned int blocks_for(unsigned int block_bytes) const
+	{
+		unsigned long long blocks = bytes_per_run / block_bytes;
+		return blocks > min_blocks_per_run ? (unsigned int)blocks : min_blocks_per_run;
+	}
+};
+
+/* The left input carries 0, 1, 2, ... in every block, the right input the
+ * block number, so the first and last word of each result tell whether
+ * the sum is right and arrived in order. */
+static void fillLeft(int* data, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+		data[i] = i;
+}
+
+static bool checkResult(const int* data, unsigned int count, unsigned int block)
+{
+	if (data[0] == (int)block && data[count - 1] == (int)(block + count - 1))
+		return true;
+	std::cerr << "Data mismatch in block " << block <<
+		" Expected: " << block << ".." << block + count - 1 <<
+		" Actual: " << data[0] << ".." << data[count - 1] << std::endl;
+	return false;
+}
+
+static Measurement finish(DmaProfile::Mode mode, unsigned int block_bytes,
+	unsigned int setting, unsigned int blocks, uint64_t elapsed_ns,
+	const LatencyHistogram &latency)
+{
+	Measurement result;
+	result.mode = mode;
+	result.block_bytes = block_bytes;
+	result.setting = setting;
+	result.mb_per_second = elapsed_ns ?
+		(double)blocks * block_bytes * 1000.0 / elapsed_ns : 0.0;
+	result.p50_ns = latency.value_at_percentile(50.0);
+	result.p99_ns = latency.value_at_percentile(99.0);
+	return result;
+}
+
+/* Feeds both inputs of the adder from its own thread, so that the main
+ * thread can read the results at the same time. Otherwise a writer that
+ * gets ahead would wait for room in the driver, while the adder waits
+ * for the writer. At most "depth" blocks are ahead of the results. */
+template <class Fifo> class CopyFeeder
+{
+	protected:
+		Fifo &to_adder_left;
+		Fifo &to_adder_right;
+		const unsigned int block_bytes;
+		const unsigned int blocks;
+		const unsigned int depth;
+		std::vector<int> left;
+		std::vector<int> right;
+		std::vector<uint64_t> sent_at;
+		unsigned int received;
+		bool stopping;
+		std::string error;
+		pthread_mutex_t mutex;
+		pthread_cond_t condition;
+		dyplo::Thread m_thread;
+	public:
+		CopyFeeder(Fifo &left_, Fifo &right_, unsigned int block_bytes_,
+				unsigned int blocks_, unsigned int depth_):
+			to_adder_left(left_),
+			to_adder_right(right_),
+			block_bytes(block_bytes_),
+			blocks(blocks_),
+			depth(depth_),
+			left(block_bytes_ / sizeof(int)),
+			right(block_bytes_ / sizeof(int)),
+			sent_at(blocks_),
+			received(0),
+			stopping(false),
+			error(),
+			m_thread()
+		{
+			pthread_mutex_init(&mutex, NULL);
+			pthread_cond_init(&condition, NULL);
+			fillLeft(&left[0], left.size());
+			m_thread.start(&run, this);
+		}
+
+		/* When the reader gave up early, don't wait for it */
+		~CopyFeeder()
+		{
+			pthread_mutex_lock(&mutex);
+			stopping = true;
+			pthread_cond_signal(&condition);
+			pthread_mutex_unlock(&mutex);
+			m_thread.join();
+			pthread_cond_destroy(&condition);
+			pthread_mutex_destroy(&mutex);
+		}
+
+		/* Called by the reader for each result block. Returns the time
+		 * at which that block was sent. */
+		uint64_t block_received()
+		{
+			pthread_mutex_lock(&mutex);
+			uint64_t result = sent_at[received];
+			++received;
+			pthread_cond_signal(&condition);
+			pthread_mutex_unlock(&mutex);
+			return result;
+		}
+
+		/* Only valid after join() */
+		const std::string& get_error() const { return error; }
+
+		void join()
+		{
+			m_thread.join();
+		}
+
+		void* process()
+		{
+			try
+			{
+				for (unsigned int block = 0; block < blocks; ++block)
+				{
+					pthread_mutex_lock(&mutex);
+					while (block >= received + depth && !stopping)
+						pthread_cond_wait(&condition, &mutex);
+					bool stop = stopping;
+					sent_at[block] = monotonic_ns();
+					pthread_mutex_unlock(&mutex);
+					if (stop)
+						break;
+					std::fill(right.begin(), right.end(), (int)block);
+					if (to_adder_left.write(&left[0], block_bytes) != (ssize_t)block_bytes ||
+						to_adder_right.write(&right[0], block_bytes) != (ssize_t)block_bytes)
+						throw std::runtime_error("Failed to write to DMA");
+				}
+			}
+			catch (const std::exception& ex)
+			{
+				error = ex.what();
+			}
+			return 0;
+		}
+	private:
+		static void* run(void* arg)
+		{
+			return ((CopyFeeder*)arg)->process();
+		}
+};
+
+/* Copy mode: Keep two blocks in flight */
+template <class Fifo> static Measurement measureCopy(
+	Fifo &to_adder_left, Fifo &to_adder_right, Fifo &from_adder,
+	unsigned int block_bytes, unsigned int threshold,
+	const CalibrationOptions &options)
+{
+	static const unsigned int depth = 2;
+	const unsigned int words = block_bytes / sizeof(int);
+	const unsigned int blocks = options.blocks_for(block_bytes);
+	std::vector<int> result(words);
+	LatencyHistogram latency;
+
+	from_adder.setDataTreshold(threshold);
+	uint64_t start = monotonic_ns();
+	CopyFeeder<Fifo> feeder(to_adder_left, to_adder_right, block_bytes, blocks, depth);
+	for (unsigned int received = 0; received < blocks; ++received)
+	{
+		readFully(from_adder, &result[0], block_bytes);
+		latency.record(monotonic_ns() - feeder.block_received());
+		if (!checkResult(&result[0], words, received))
+			throw std::runtime_error("Calibration aborted");
+	}
+	uint64_t elapsed = monotonic_ns() - start;
+	feeder.join();
+	if (!feeder.get_error().empty())
+		throw std::runtime_error(feeder.get_error());
+	return finish(DmaProfile::COHERENT, block_bytes, threshold, blocks,
+		elapsed, latency);
+}
+
+/* Zero-copy mode: All blocks are in flight, the sender waits for a free
+ * block before filling it. */
+template <class DMAFifo> static Measurement measureZeroCopy(
+	DMAFifo &to_adder_left, DMAFifo &to_adder_right, DMAFifo &from_adder,
+	DmaProfile::Mode mode, unsigned int block_bytes, unsigned int num_blocks,
+	const CalibrationOptions &options)
+{
+	const unsigned int words = block_bytes / sizeof(int);
+	unsigned int blocks = options.blocks_for(block_bytes);
+	if (blocks < 2 * num_blocks)
+		blocks = 2 * num_blocks;
+	std::vector<uint64_t> sent_at(num_blocks);
+	LatencyHistogram latency;
+
+	unsigned int dma_mode = (mode == DmaProfile::STREAMING) ?
+		DMAFifo::MODE_STREAMING : DMAFifo::MODE_COHERENT;
+	to_adder_left.reconfigure(dma_mode, block_bytes, num_blocks, false);
+	to_adder_right.reconfigure(dma_mode, block_bytes, num_blocks, false);
+	from_adder.reconfigure(dma_mode, block_bytes, num_blocks, true);
+
+	for (unsigned int i = 0; i < num_blocks; ++i)
+	{
+		typename DMAFifo::Block *block = from_adder.dequeue();
+		block->bytes_used = block_bytes;
+		from_adder.enqueue(block);
+	}
+
+	unsigned int sent = 0;
+	uint64_t start = monotonic_ns();
+	for (unsigned int received = 0; received < blocks; ++received)
+	{
+		while (sent < blocks && sent < received + num_blocks)
+		{
+			typename DMAFifo::Block *block = to_adder_left.dequeue();
+			sent_at[sent % num_blocks] = monotonic_ns();
+			fillLeft((int*)block->data, words);
+			block->bytes_used = block_bytes;
+			to_adder_left.enqueue(block);
+			block = to_adder_right.dequeue();
+			std::fill((int*)block->data, (int*)block->data + words, (int)sent);
+			block->bytes_used = block_bytes;
+			to_adder_right.enqueue(block);
+			++sent;
+		}
+		typename DMAFifo::Block *block = from_adder.dequeue();
+		latency.record(monotonic_ns() - sent_at[received % num_blocks]);
+		if (block->bytes_used != block_bytes ||
+			!checkResult((const int*)block->data, words, received))
+			throw std::runtime_error("Calibration aborted");
+		/* Only hand back as many blocks as there is data left, so the
+		 * reader is idle before the next reconfigure. */
+		if (received + num_blocks < blocks)
+		{
+			block->bytes_used = block_bytes;
+			from_adder.enqueue(block);
+		}
+	}
+	return finish(mode, block_bytes, num_blocks, blocks,
+		monotonic_ns() - start, latency);
+}
+
+static void printHeader(const char *setting_name)
+{
+	std::cout << "#     mode   block " << std::setw(8) << setting_name <<
+		"      MB/s    p50 us    p99 us" << std::endl;
+}
+
+static void printMeasurement(const Measurement &m, bool zero_copy)
+{
+	const char *mode = !zero_copy ? "copy" :
+		(m.mode == DmaProfile::STREAMING ? "streaming" : "coherent");
+	std::cout << std::fixed << std::setprecision(1)
+		<< std::setw(10) << mode
+		<< std::setw(8) << m.block_bytes
+		<< std::setw(9) << m.setting
+		<< std::setw(10) << m.mb_per_second
+		<< std::setw(10) << m.p50_ns / 1000.0
+		<< std::setw(10) << m.p99_ns / 1000.0 << std::endl;
+}
+
+/* Highest throughput within the latency target. If nothing meets the
+ * target, the lowest latency. */
+static const Measurement& choose(const std::vector<Measurement> &results,
+	unsigned int latency_target_us)
+{
+	const uint64_t target_ns = (uint64_t)latency_target_us * 1000;
+	const Measurement *best = NULL;
+	for (unsigned int i = 0; i < results.size(); ++i)
+	{
+		const Measurement &m = results[i];
+		if (target_ns && m.p99_ns > target_ns)
+			continue;
+		if (best == NULL || m.mb_per_second > best->mb_per_second)
+			best = &m;
+	}
+	if (best != NULL)
+		return *best;
+	std::cerr << "No setting meets the latency target of " <<
+		latency_target_us << " us, using the lowest latency\n";
+	best = &results[0];
+	for (unsigned int i = 1; i < results.size(); ++i)
+		if (results[i].p99_ns < best->p99_ns)
+			best = &results[i];
+	return *best;
+}
+
+template <class Fifo> static void calibrateCopy(
+	Fifo &to_adder_left, Fifo &to_adder_right, Fifo &from_adder,
+	const CalibrationOptions &options, DmaProfile &profile)
+{
+	std::vector<Measurement> results;
+	printHeader("thresh");
+	for (unsigned int b = 0; b < ARRAY_SIZE(block_sizes); ++b)
+	{
+		if (block_sizes[b] > options.copy_buffer_bytes)
+			break;
+		for (unsigned int t = 0; t < ARRAY_SIZE(threshold_divisors); ++t)
+		{
+			unsigned int threshold = block_sizes[b] / threshold_divisors[t];
+			results.push_back(measureCopy(to_adder_left, to_adder_right, from_adder,
+				block_sizes[b], threshold, options));
+			printMeasurement(results.back(), false);
+		}
+	}
+	if (results.empty())
+		throw std::runtime_error("The copy-mode buffer is smaller than the smallest block");
+	const Measurement &best = choose(results, options.latency_target_us);
+	profile.copy_block_bytes = best.block_bytes;
+	profile.copy_threshold_bytes = best.setting;
+	std::cout << "# selected:" << std::endl;
+	printMeasurement(best, false);
+}
+
+template <class DMAFifo> static void calibrateZeroCopy(
+	DMAFifo &to_adder_left, DMAFifo &to_adder_right, DMAFifo &from_adder,
+	const CalibrationOptions &options, DmaProfile &profile)
+{
+	std::vector<Measurement> results;
+	printHeader("blocks");
+	for (unsigned int m = 0; m < ARRAY_SIZE(memory_modes); ++m)
+	{
+		for (unsigned int b = 0; b < ARRAY_SIZE(block_sizes); ++b)
+		{
+			for (unsigned int n = 0; n < ARRAY_SIZE(block_counts); ++n)
+			{
+				results.push_back(measureZeroCopy(to_adder_left, to_adder_right, from_adder,
+					memory_modes[m], block_sizes[b], block_counts[n], options));
+				printMeasurement(results.back(), true);
+			}
+		}
+	}
+	const Measurement &best = choose(results, options.latency_target_us);
+	profile.zerocopy_mode = best.mode;
+	profile.zerocopy_block_bytes = best.block_bytes;
+	profile.zerocopy_blocks = best.setting;
+	std::cout << "# selected:" << std::endl;
+	printMeasurement(best, true);
+}
+
+static void calibrateSoftware(const CalibrationOptions &options, DmaProfile &profile)
+{
+	{
+		SoftwareFifo to_adder_left(options.copy_buffer_bytes);
+		SoftwareFifo to_adder_right(options.copy_buffer_bytes);
+		SoftwareFifo from_adder(options.copy_buffer_bytes);
+		SoftwareCopyAdder adder(to_adder_left, to_adder_right, from_adder);
+		calibrateCopy(to_adder_left, to_adder_right, from_adder, options, profile);
+	}
+	{
+		SoftwareDMAFifo to_adder_left;
+		SoftwareDMAFifo to_adder_right;
+		SoftwareDMAFifo from_adder;
+		SoftwareZeroCopyAdder adder(to_adder_left, to_adder_right, from_adder);
+		calibrateZeroCopy(to_adder_left, to_adder_right, from_adder, options, profile);
+	}
+}
+
+static void calibrateHardware(const CalibrationOptions &options, DmaProfile &profile)
+{
+	// Create objects for hardware control
+	dyplo::HardwareContext hardware;
+	dyplo::HardwareControl hwControl(hardware);
+
+	// set base path where to find the partials bitstreams
+	std::string libraryName = "hdl_node_examples";
+	std::string bitstreamBasePath = "/usr/share/bitstreams/" + libraryName;
+	hardware.setBitstreamBasepath(bitstreamBasePath);
+
+	// Program the hardware. See dyplodemoapp.cpp for more details.
+	static const char *function_name = "joining_adder";
+	std::string filename = hardware.findPartition(function_name, 2);
+	dyplo::HardwareConfig joiningAdderCfg(hardware, 2);
+	joiningAdderCfg.disableNode();
+	hwControl.program(filename.c_str());
+	joiningAdderCfg.enableNode();
+	int joiningAdderId = joiningAdderCfg.getNodeIndex();
+
+	// The DMA channels can be opened in only one mode at a time, so
+	// each mode gets its own set of handles. See dyploexampledma.cpp
+	// and dyploexamplezdma.cpp.
+	{
+		dyplo::HardwareFifo to_adder_left(hardware.openDMA(0, O_WRONLY));
+		dyplo::HardwareFifo to_adder_right(hardware.openDMA(1, O_WRONLY));
+		dyplo::HardwareFifo from_adder(hardware.openDMA(0, O_RDONLY));
+		to_adder_left.addRouteTo(joiningAdderId + (0 << 8));
+		to_adder_right.addRouteTo(joiningAdderId + (1 << 8));
+		from_adder.addRouteFrom(joiningAdderId);
+		calibrateCopy(to_adder_left, to_adder_right, from_adder, options, profile);
+	}
+	{
+		dyplo::HardwareDMAFifo to_adder_left(hardware.openDMA(0, O_RDWR));
+		dyplo::HardwareDMAFifo to_adder_right(hardware.openDMA(1, O_RDWR));
+		dyplo::HardwareDMAFifo from_adder(hardware.openDMA(0, O_RDONLY));
+		to_adder_left.addRouteTo(joiningAdderId + (0 << 8));
+		to_adder_right.addRouteTo(joiningAdderId + (1 << 8));
+		from_adder.addRouteFrom(joiningAdderId);
+		calibrateZeroCopy(to_adder_left, to_adder_right, from_adder, options, profile);
+	}
+}
+
+static void usage(const char *name)
+{
+	std::cerr << "usage: " << name << " [-s] [-o profile] [-l us] [-n MB] [-b bytes]\n"
+		"  -s  Use software stand-ins instead of the FPGA\n"
+		"  -o  Where to store the profile (default: $DYPLO_DMA_PROFILE or "
+		DYPLO_DMA_PROFILE_DEFAULT_PATH ")\n"
+		"  -l  Maximum 99th percentile latency per block in microseconds\n"
+		"  -n  Megabytes to transfer for each setting (default 16)\n"
+		"  -b  Size of the driver's copy-mode DMA buffer (default 65536),\n"
+		"      larger copy-mode blocks are not tried\n";
+}
+
+int main(int argc, char** argv)
+{
+	CalibrationOptions options;
+	bool software = false;
+	const char *profile_path = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "so:l:n:b:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				software = true;
+				break;
+			case 'o':
+				profile_path = optarg;
+				break;
+			case 'l':
+				options.latency_target_us = atoi(optarg);
+				break;
+			case 'n':
+				options.bytes_per_run = strtoull(optarg, NULL, 0) << 20;
+				break;
+			case 'b':
+				options.copy_buffer_bytes = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	try
+	{
+		DmaProfile profile;
+		if (software)
+			calibrateSoftware(options, profile);
+		else
+			calibrateHardware(options, profile);
+		std::string path = DmaProfile::path(profile_path);
+		profile.save(path);
+		std::cerr << "Profile written to " << path << std::endl;
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "ERROR:\n" << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
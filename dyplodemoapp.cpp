@@ -65,16 +65,27 @@
                      | Displays the result |
                      -----------------------
 
+    Instead of keyboard input, the pipeline can be fed by an open-loop
+    load generator (see loadgenerator.hpp). The display node then records
+    the latency of each item, and a line with latency percentiles is
+    printed for every offered rate. Run with "-h" for the options.
 */
 
 #include "dyplo/hardware.hpp"
 #include <unistd.h>
+#include <fcntl.h>
 #include <iostream>
 #include <sstream>
 #include <string.h>
+#include <stdlib.h>
 #include <ctype.h>
+#include <vector>
 
 #include "softwareprocesses.hpp"
+#include "coalescingqueue.hpp"
+#include "loadgenerator.hpp"
+#include "socketserver.hpp"
+#include "spliceforwarder.hpp"
 
 #include "dyplo/threadedprocess.hpp"
 #include "dyplo/cooperativescheduler.hpp"
@@ -85,10 +96,10 @@
   #include "dyplo/filequeue.hpp"
 #endif
 
-template <class T, int raise, int blocksize> void process_block_add_constant(T* dest, T* src)
+template <class Arithmetic, int raise, int blocksize>
+void process_block_add_constant(typename Arithmetic::Element* dest, typename Arithmetic::Element* src)
 {
-  for (int i = 0; i < blocksize; ++i)
-    *dest++ = (*src++) + raise;
+  add_constant_block<Arithmetic>(dest, src, Arithmetic::convert(raise), blocksize);
 }
 
 int string_to_int(const std::string& src)
@@ -108,15 +119,244 @@ int string_to_int(const std::string& src)
   return result;
 }
 
-void display_int(int* src)
+// Set in load generation mode, the display node then records latencies
+// instead of printing the results.
+static LatencyRecorder *latency_recorder = NULL;
+
+// Set in socket server mode, the display node then returns the results
+// to the clients that sent the input.
+template <class T> struct ResultServer
+{
+  static SocketIngestServer<T> *instance;
+};
+template <class T> SocketIngestServer<T> *ResultServer<T>::instance = NULL;
+
+template <class T> void stop_result_server(int)
 {
-  std::cout << *src << std::endl;
+  ResultServer<T>::instance->stop();
 }
 
-int main(int argc, char** argv)
+// Makes "server" receive the results and the stop signals. Undone on
+// destruction, so that neither the display process nor a late signal
+// can reach a server that no longer exists.
+template <class T> class ResultServerRegistration
 {
-  try
+  protected:
+    bool installed;
+  public:
+    ResultServerRegistration():
+      installed(false)
+    {
+    }
+
+    void install(SocketIngestServer<T> *server)
+    {
+      ResultServer<T>::instance = server;
+      signal(SIGINT, stop_result_server<T>);
+      signal(SIGTERM, stop_result_server<T>);
+      installed = true;
+    }
+
+    ~ResultServerRegistration()
+    {
+      if (installed)
+      {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        ResultServer<T>::instance = NULL;
+      }
+    }
+};
+
+template <class T> void display_sample(T* src)
+{
+  if (latency_recorder != NULL)
+    latency_recorder->item_received();
+  else if (ResultServer<T>::instance != NULL)
+    ResultServer<T>::instance->result_ready(*src);
+  else
+    std::cout << (int)*src << std::endl;
+}
+
+// The software queues in the pipeline. In the hardware build, only the
+// input queue is a software queue.
+enum Edge { EDGE_INPUT, EDGE_ADDER, EDGE_JOINING_LEFT, EDGE_JOINING_RIGHT, EDGE_OUTPUT, EDGE_COUNT };
+static const char* const edge_names[EDGE_COUNT] = { "input", "adder", "joining_left", "joining_right", "output" };
+
+struct EdgeConfig
+{
+  // Zero means room for two blocks
+  unsigned int capacity;
+  NotifyPolicy policy;
+
+  EdgeConfig():
+    capacity(0),
+    policy()
+  {
+  }
+
+  // The processes move whole blocks, so a queue must hold a whole
+  // number of them. Otherwise a block would wrap around the end.
+  unsigned int capacity_for(unsigned int block_size) const
+  {
+    if (capacity == 0)
+      return 2 * block_size;
+    if (capacity % block_size)
+      throw std::runtime_error("Queue capacity must be a multiple of the block size");
+    return capacity;
+  }
+};
+
+struct Options
+{
+  EdgeConfig edges[EDGE_COUNT];
+  std::vector<double> load_rates;
+  unsigned int load_burst;
+  double load_duration;
+  const char* load_replay_file;
+  unsigned int sample_bits;
+  bool saturate;
+  unsigned int block_size;
+  const char* socket_path;
+  unsigned int socket_max_pending;
+  bool forward;
+  const char* forward_targets;
+
+  Options():
+    edges(),
+    load_rates(),
+    load_burst(1),
+    load_duration(2.0),
+    load_replay_file(NULL),
+    sample_bits(32),
+    saturate(false),
+    block_size(1),
+    socket_path(NULL),
+    socket_max_pending(4096),
+    forward(false),
+    forward_targets(NULL)
   {
+  }
+};
+
+static void usage(const char* name)
+{
+  std::cerr << "usage: " << name << " [-q edge=capacity[,watermark,delay]] [-w bits] [-s] [-k items]\n"
+    "        [-r rate[,rate...]] [-b burst] [-d seconds] [-f file] [-u socket] [-m max]\n"
+    "        [-z [-o left,right]]\n"
+    "Without options, numbers are read from stdin and the results printed.\n"
+    " -q  Queue size and wakeup policy of an edge (input, adder, joining_left,\n"
+    "     joining_right, output). The waiting side is woken once 'watermark'\n"
+    "     items or slots are available, or after 'delay' microseconds.\n"
+    "     Default is a capacity of two blocks, watermark 1. The hardware\n"
+    "     build only has the input edge.\n"
+    " -w  Sample width: 32 (default), 16 or 8 bits. Software build only.\n"
+    " -s  Saturate instead of wrap around on overflow. Software build only.\n"
+    " -k  Block size: 1 (default), 16 or 64 items per processing step.\n"
+    "     Larger blocks are added with vector instructions, but items\n"
+    "     only move on once a block is full. Software build only.\n"
+    " -r  Generate load at the given rate(s) in items per second. A list\n"
+    "     of rates results in a latency versus offered load curve.\n"
+    " -b  Send items in bursts of this size, at the same average rate.\n"
+    " -d  Duration of each load step in seconds (default 2).\n"
+    " -f  Replay send times from file, one timestamp in microseconds per line.\n"
+    " -u  Serve clients on a UNIX-domain socket. Clients send samples in\n"
+    "     binary form and receive the results on the same connection.\n"
+    " -m  Maximum samples per client in the pipeline (default 4096).\n"
+    " -z  Forward raw binary samples from stdin to the adder FIFOs with\n"
+    "     splice(2), without copying them through the Tee node.\n"
+    " -o  With -z, forward to these two files instead of the FIFOs.\n";
+}
+
+static void parse_edge(const char* arg, Options& options)
+{
+  std::string text(arg);
+  std::string::size_type eq = text.find('=');
+  int edge = EDGE_COUNT;
+  if (eq != std::string::npos)
+    for (edge = 0; edge < EDGE_COUNT; ++edge)
+      if (text.compare(0, eq, edge_names[edge]) == 0)
+        break;
+  if (edge == EDGE_COUNT)
+    throw std::runtime_error("Invalid edge: " + text);
+#ifdef HAVE_HARDWARE
+  // The other edges are FIFOs of the hardware nodes
+  if (edge != EDGE_INPUT)
+    throw std::runtime_error("Only the input edge can be configured in the hardware build: " + text);
+#endif
+  EdgeConfig &config = options.edges[edge];
+  char separator;
+  std::istringstream input(text.substr(eq + 1));
+  input >> config.capacity;
+  bool valid = !input.fail() && config.capacity != 0;
+  if (valid && !input.eof())
+  {
+    input >> separator;
+    valid = !input.fail() && separator == ',';
+    input >> config.policy.watermark >> separator;
+    valid = valid && !input.fail() && separator == ',';
+    input >> config.policy.max_delay_us;
+    valid = valid && !input.fail() && input.eof();
+  }
+  if (!valid)
+    throw std::runtime_error("Invalid edge configuration: " + text);
+}
+
+// The last partial block would never leave the pipeline
+static unsigned int whole_blocks(unsigned int items, unsigned int block_size)
+{
+  return (items + block_size - 1) / block_size * block_size;
+}
+
+static std::vector<double> parse_rates(const char* arg)
+{
+  std::vector<double> result;
+  std::istringstream input(arg);
+  std::string item;
+  while (std::getline(input, item, ','))
+  {
+    double rate = atof(item.c_str());
+    if (rate <= 0)
+      throw std::runtime_error("Invalid rate: " + item);
+    result.push_back(rate);
+  }
+  return result;
+}
+
+/* Forward stdin to two files (or pipes), as the hardware build does with
+ * the FIFOs to the adders. This allows testing without hardware. The
+ * stream is only split at whole samples of "sample_bytes". */
+static int forward_to_files(const char* targets, unsigned int sample_bytes)
+{
+  std::string text(targets);
+  std::string::size_type comma = text.find(',');
+  if (comma == std::string::npos)
+    throw std::runtime_error("Expected two files: " + text);
+  std::string left_name = text.substr(0, comma);
+  std::string right_name = text.substr(comma + 1);
+  int left = open(left_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (left == -1)
+    throw std::runtime_error("Cannot open " + left_name);
+  int right = open(right_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (right == -1)
+  {
+    close(left);
+    throw std::runtime_error("Cannot open " + right_name);
+  }
+  {
+    SpliceForwarder forwarder(STDIN_FILENO, left, right, sample_bytes);
+    forwarder.run();
+  }
+  close(right);
+  close(left);
+  return 0;
+}
+
+/* Builds the pipeline for samples of type T and runs it. The hardware
+ * nodes work on 32-bit words, so the hardware build only uses T=int.
+ * The software processes read and write "blocksize" items at a time. */
+template <class T, class Arithmetic, int blocksize> int run_pipeline(const Options& options)
+{
 #ifdef HAVE_HARDWARE
     // Create objects for hardware control
     dyplo::HardwareContext hardware;
@@ -149,28 +389,35 @@ int main(int argc, char** argv)
     joiningAdderCfg.enableNode();
 #endif
 
+    // Must outlive the display process, which reports to these in load
+    // and socket server mode.
+    LatencyRecorder recorder;
+    SocketIngestServer<T> server;
+    ResultServerRegistration<T> server_registration;
+
 /* --- STEP 1 - CREATE QUEUES ---
    Create the queues first, because they need to exist before
    the processes are started, and at least for as long as the
    processes run.
 */
-    dyplo::FixedMemoryQueue<int, dyplo::PthreadScheduler> q_input(2);
+    const EdgeConfig *edges = options.edges;
+    CoalescingQueue<T> q_input(edges[EDGE_INPUT].capacity_for(blocksize), edges[EDGE_INPUT].policy);
 #ifdef HAVE_HARDWARE
     dyplo::HardwareFifo f_adder(hardware.openFifo(0, O_WRONLY));
-    dyplo::FileOutputQueue<int, true> q_adder(hardwareScheduler, f_adder, 16);
+    dyplo::FileOutputQueue<T, true> q_adder(hardwareScheduler, f_adder, 16);
     dyplo::HardwareFifo f_joining_adder_right(hardware.openFifo(1, O_WRONLY));
-    dyplo::FileOutputQueue<int, true> q_joining_adder_right(hardwareScheduler, f_joining_adder_right, 16);
+    dyplo::FileOutputQueue<T, true> q_joining_adder_right(hardwareScheduler, f_joining_adder_right, 16);
     dyplo::HardwareFifo f_output(hardware.openFifo(0, O_RDONLY));
-    dyplo::FileInputQueue<int> q_output(hardwareScheduler, f_output, 16);
+    dyplo::FileInputQueue<T> q_output(hardwareScheduler, f_output, 16);
 #else
-    dyplo::FixedMemoryQueue<int, dyplo::PthreadScheduler> q_adder(2);
-    dyplo::FixedMemoryQueue<int, dyplo::PthreadScheduler> q_joining_adder_left(2);
-    dyplo::FixedMemoryQueue<int, dyplo::PthreadScheduler> q_joining_adder_right(2);
-    dyplo::FixedMemoryQueue<int, dyplo::PthreadScheduler> q_output(2);
+    CoalescingQueue<T> q_adder(edges[EDGE_ADDER].capacity_for(blocksize), edges[EDGE_ADDER].policy);
+    CoalescingQueue<T> q_joining_adder_left(edges[EDGE_JOINING_LEFT].capacity_for(blocksize), edges[EDGE_JOINING_LEFT].policy);
+    CoalescingQueue<T> q_joining_adder_right(edges[EDGE_JOINING_RIGHT].capacity_for(blocksize), edges[EDGE_JOINING_RIGHT].policy);
+    CoalescingQueue<T> q_output(edges[EDGE_OUTPUT].capacity_for(blocksize), edges[EDGE_OUTPUT].policy);
 #endif
 
 /* --- STEP 2 - CREATE PROCESSES --- */    
-    TeeProcess<typeof(q_input), typeof(q_adder), typeof(q_joining_adder_right)> p_tee;
+    TeeProcess<typeof(q_input), typeof(q_adder), typeof(q_joining_adder_right), blocksize> p_tee;
     // This number will be added by the 'adder function':
     const int number_to_add = 8;
 #ifdef HAVE_HARDWARE
@@ -179,17 +426,21 @@ int main(int argc, char** argv)
     // via the AXI bus to the offsets corresponding to the file position.
     adderCfg.write(&number_to_add, sizeof(number_to_add));
 #else
-    dyplo::ThreadedProcess<typeof(q_adder), typeof(q_joining_adder_left), process_block_add_constant<int, number_to_add, 1> > p_adder;
-    JoiningAddProcess<typeof(q_joining_adder_left), typeof(q_joining_adder_right), typeof(q_output)> p_joining_adder;
+    dyplo::ThreadedProcess<typeof(q_adder), typeof(q_joining_adder_left), process_block_add_constant<Arithmetic, number_to_add, blocksize>, blocksize> p_adder;
+    JoiningAddProcess<typeof(q_joining_adder_left), typeof(q_joining_adder_right), typeof(q_output), blocksize, Arithmetic> p_joining_adder;
 #endif
-    ThreadedProcessSink<typeof(q_output), display_int, 1> p_display_int;
+    ThreadedProcessSink<typeof(q_output), display_sample<T>, 1> p_display;
 
 /*  --- STEP 3 - CONNECT PROCESSES ---
     Connect the processes and queues from output to input.
 */
-    p_tee.set_input(&q_input);
-    p_tee.set_output_left(&q_adder);
-    p_tee.set_output_right(&q_joining_adder_right);
+    // When forwarding, the data bypasses the Tee node and its queues
+    if (!options.forward)
+    {
+      p_tee.set_input(&q_input);
+      p_tee.set_output_left(&q_adder);
+      p_tee.set_output_right(&q_joining_adder_right);
+    }
 #ifdef HAVE_HARDWARE
     // CPU node Fifo 0 to node 1 fifo 0
     f_adder.addRouteTo(1);
@@ -207,7 +458,44 @@ int main(int argc, char** argv)
     p_joining_adder.set_input_right(&q_joining_adder_right);
     p_joining_adder.set_output(&q_output);
 #endif
-    p_display_int.set_input(&q_output);
+    p_display.set_input(&q_output);
+
+#ifdef HAVE_HARDWARE
+    if (options.forward)
+    {
+      // Nothing to transform on the CPU, so let the kernel move the raw
+      // input into both FIFOs. As with keyboard input, results still in
+      // the pipeline at the end of the input may be lost.
+      SpliceForwarder forwarder(STDIN_FILENO, f_adder.handle, f_joining_adder_right.handle, sizeof(T));
+      forwarder.run();
+      return 0;
+    }
+#endif
+
+    if (options.load_replay_file != NULL || !options.load_rates.empty())
+    {
+      latency_recorder = &recorder;
+      print_load_header(std::cout);
+      if (options.load_replay_file != NULL)
+      {
+        LoadSchedule schedule = LoadSchedule::replay(options.load_replay_file);
+        run_load_step(q_input, schedule, whole_blocks(schedule.items_for(0), blocksize), recorder, std::cout);
+      }
+      for (std::vector<double>::const_iterator rate = options.load_rates.begin(); rate != options.load_rates.end(); ++rate)
+      {
+        LoadSchedule schedule = LoadSchedule::bursty(*rate, options.load_burst);
+        run_load_step(q_input, schedule, whole_blocks(schedule.items_for(options.load_duration), blocksize), recorder, std::cout);
+      }
+      return 0;
+    }
+
+    if (options.socket_path != NULL)
+    {
+      server.listen(options.socket_path, options.socket_max_pending);
+      server_registration.install(&server);
+      server.run(q_input);
+      return 0;
+    }
 
     // Loop reading the input until end of file. Note that output
     // is not handled correctly, the program will simply 'abort'
@@ -218,8 +506,116 @@ int main(int argc, char** argv)
       std::cin >> line;
       if (std::cin.eof())
         break;
-      q_input.push_one(string_to_int(line));
+      q_input.push_one(Arithmetic::convert(string_to_int(line)));
     }
+    return 0;
+}
+
+template <class T, class Arithmetic> int run_pipeline_blocks(const Options& options)
+{
+  switch (options.block_size)
+  {
+    case 1:
+      return run_pipeline<T, Arithmetic, 1>(options);
+    case 16:
+      return run_pipeline<T, Arithmetic, 16>(options);
+    case 64:
+      return run_pipeline<T, Arithmetic, 64>(options);
+    default:
+      throw std::runtime_error("Block size must be 1, 16 or 64");
+  }
+}
+
+template <class T> int run_pipeline_for(const Options& options)
+{
+  if (options.saturate)
+    return run_pipeline_blocks<T, SaturatingArithmetic<T> >(options);
+  return run_pipeline_blocks<T, WrappingArithmetic<T> >(options);
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+
+  try
+  {
+    int opt;
+    while ((opt = getopt(argc, argv, "q:w:sk:r:b:d:f:u:m:zo:h")) != -1)
+    {
+      switch (opt)
+      {
+        case 'q':
+          parse_edge(optarg, options);
+          break;
+        case 'w':
+          options.sample_bits = atoi(optarg);
+          break;
+        case 's':
+          options.saturate = true;
+          break;
+        case 'k':
+          options.block_size = atoi(optarg);
+          break;
+        case 'r':
+          options.load_rates = parse_rates(optarg);
+          break;
+        case 'b':
+          options.load_burst = atoi(optarg);
+          break;
+        case 'd':
+          options.load_duration = atof(optarg);
+          break;
+        case 'f':
+          options.load_replay_file = optarg;
+          break;
+        case 'u':
+          options.socket_path = optarg;
+          break;
+        case 'm':
+          options.socket_max_pending = atoi(optarg);
+          break;
+        case 'z':
+          options.forward = true;
+          break;
+        case 'o':
+          options.forward_targets = optarg;
+          break;
+        default:
+          usage(argv[0]);
+          return 1;
+      }
+    }
+
+    if (options.forward_targets != NULL)
+    {
+      if (!options.forward)
+        throw std::runtime_error("-o only applies to forwarding (-z)");
+      if (options.sample_bits != 32 && options.sample_bits != 16 && options.sample_bits != 8)
+        throw std::runtime_error("Sample width must be 32, 16 or 8");
+      return forward_to_files(options.forward_targets, options.sample_bits / 8);
+    }
+
+#ifdef HAVE_HARDWARE
+    if (options.sample_bits != 32 || options.saturate)
+      throw std::runtime_error("The hardware nodes only support 32-bit wrapping arithmetic");
+    if (options.block_size != 1)
+      throw std::runtime_error("The block size only applies to the software build");
+    return run_pipeline<int, WrappingArithmetic<int>, 1>(options);
+#else
+    if (options.forward)
+      throw std::runtime_error("Forwarding needs the hardware FIFOs, or -o to forward to files");
+    switch (options.sample_bits)
+    {
+      case 32:
+        return run_pipeline_for<int>(options);
+      case 16:
+        return run_pipeline_for<int16_t>(options);
+      case 8:
+        return run_pipeline_for<int8_t>(options);
+      default:
+        throw std::runtime_error("Sample width must be 32, 16 or 8");
+    }
+#endif
   }
   catch (const std::exception& ex)
   {
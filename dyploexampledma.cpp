@@ -34,18 +34,73 @@
 #include <unistd.h>
 #include <string>
 #include <iostream>
+#include "testpattern.hpp"
+#include "dmaprofile.hpp"
 
-// Fill a buffer with numbers seed, seed+1, ..., seed+count-1
-static void fillBuffer(int* buffer, int seed, unsigned int count)
+static int transfer(dyplo::HardwareFifo &to_adder_left,
+	dyplo::HardwareFifo &to_adder_right, dyplo::HardwareFifo &from_adder,
+	const DmaProfile &profile)
 {
-	for (unsigned int i = 0; i < count; ++i)
-		buffer[i] = seed + i;
+	// Allocate a buffer. The block size comes from the DMA profile, see
+	// dyplocalibratedma.cpp.
+	const unsigned int bytes_per_block = profile.copy_block_bytes;
+	const unsigned int samples_per_block = bytes_per_block / sizeof(int);
+	int* data = new int[samples_per_block];
+
+	/* The outgoing DMA will transfer data blocks as we provide them. The
+	 * incoming DMA will only trigger when enough data is available. You can
+	 * get/set this threshold value if the block size is important. */
+	from_adder.setDataTreshold(profile.copy_threshold_bytes);
+
+	fillBuffer(data, test_pattern_seed, samples_per_block);
+	/* Writing to DMA will not block (if there's room in the DMA buffers in the
+	 * driver). So we can send a substantial amount of data to the system, and
+	 * the FPGA will do its work in the background. */
+	to_adder_left.write(data, bytes_per_block);
+
+	fillBuffer(data, -test_pattern_seed, samples_per_block);
+	to_adder_right.write(data, bytes_per_block);
+
+	/* Fetch the data. This will block until processing is ready. With a
+	 * threshold below the block size, a read may return less than a
+	 * block, so repeat until it's complete. */
+	readFully(from_adder, data, bytes_per_block);
+
+	bool ok = checkBuffer(data, samples_per_block);
+	delete [] data;
+	if (!ok)
+		return 2;
+
+	std::cerr << "OK: " << bytes_per_block << " bytes (" <<
+		samples_per_block << " samples) processed\n";
+	return 0;
 }
 
 int main(int argc, char** argv)
 {
+	const char *profile_file = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "P:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'P':
+				profile_file = optarg;
+				break;
+			default:
+				std::cerr << "usage: " << argv[0] << " [-P profile]\n";
+				return 1;
+		}
+	}
+
 	try
 	{
+		// Load the tuned DMA settings, if there are any
+		DmaProfile profile;
+		std::string profile_path = DmaProfile::path(profile_file);
+		if (profile.load(profile_path))
+			std::cerr << "Using DMA profile " << profile_path << "\n";
+
 		// Create objects for hardware control
 		dyplo::HardwareContext hardware;
 		dyplo::HardwareControl hwControl(hardware);
@@ -77,43 +132,7 @@ int main(int argc, char** argv)
 		to_adder_right.addRouteTo(joiningAdderId + (1 << 8));
 		from_adder.addRouteFrom(joiningAdderId);
 
-		// Allocate a buffer
-		static const unsigned int samples_per_block = 4096;
-		static const unsigned int bytes_per_block = samples_per_block * sizeof(int);
-		int* data = new int[samples_per_block];
-
-		/* The outgoing DMA will transfer data blocks as we provide them. The
-		 * incoming DMA will only trigger when enough data is available. You can
-		 * get/set this threshold value if the block size is important. */
-		from_adder.setDataTreshold(bytes_per_block);
-
-		fillBuffer(data, 1000, samples_per_block);
-		/* Writing to DMA will not block (if there's room in the DMA buffers in the
-		 * driver). So we can send a substantial amount of data to the system, and
-		 * the FPGA will do its work in the background. */
-		to_adder_left.write(data, bytes_per_block);
-
-		fillBuffer(data, -1000, samples_per_block);
-		to_adder_right.write(data, bytes_per_block);
-
-		/* Fetch the data. This will block until processing is ready. */
-		from_adder.read(data, bytes_per_block);
-
-		// Compare the results to what we expect to get (basically, do
-		// the same calculation on the CPU)
-		for (unsigned int i = 0; i < samples_per_block; ++i)
-		{
-			if (data[i] != 2 * (int)i)
-			{
-				std::cerr << "Data mismatch at " << i <<
-					" Expected: " << 2*i <<
-					" Actual: " << data[i] <<
-					std::endl;
-				return 2;
-			}
-		}
-
-		std::cerr << "OK: " << bytes_per_block << " bytes processed\n";
+		return transfer(to_adder_left, to_adder_right, from_adder, profile);
 	}
 	catch (const std::exception& ex)
 	{
@@ -39,18 +39,99 @@
 #include <unistd.h>
 #include <string>
 #include <iostream>
+#include "testpattern.hpp"
+#include "dmaprofile.hpp"
 
-// Fill a buffer with numbers seed, seed+1, ..., seed+count-1
-static void fillBuffer(int* buffer, int seed, unsigned int count)
+static int transfer(dyplo::HardwareDMAFifo &to_adder_left,
+	dyplo::HardwareDMAFifo &to_adder_right, dyplo::HardwareDMAFifo &from_adder,
+	const DmaProfile &profile)
 {
-	for (unsigned int i = 0; i < count; ++i)
-		buffer[i] = seed + i;
+	/* Allocate buffers, because of the zero-copy system, the driver
+	 * will allocate them for us in DMA capable memory, and give us
+	 * direct access through a memory map. The library does all the
+	 * work for us. The block size, number of blocks and memory mode come
+	 * from the DMA profile, see dyplocalibratedma.cpp. */
+	const unsigned int bytes_per_block = profile.zerocopy_block_bytes;
+	const unsigned int samples_per_block = bytes_per_block / sizeof(int);
+	const unsigned int num_blocks = profile.zerocopy_blocks;
+	const unsigned int mode = (profile.zerocopy_mode == DmaProfile::STREAMING) ?
+		dyplo::HardwareDMAFifo::MODE_STREAMING : dyplo::HardwareDMAFifo::MODE_COHERENT;
+	to_adder_left.reconfigure(mode, bytes_per_block, num_blocks, false);
+	to_adder_right.reconfigure(mode, bytes_per_block, num_blocks, false);
+	from_adder.reconfigure(mode, bytes_per_block, num_blocks, true);
+
+	/* Prime the reader with empty blocks. Just dequeue all blocks
+	 * and enqueue them. */
+	for (unsigned int i = 0; i < num_blocks; ++i)
+	{
+		dyplo::HardwareDMAFifo::Block *block = from_adder.dequeue();
+		block->bytes_used = bytes_per_block;
+		from_adder.enqueue(block);
+	}
+
+	/* Start data transfer on the senders. To send data, first dequeue
+	 * a block from the DMA, fill it with data and set the "bytes_used"
+	 * member. Then enqueue it. Do not access the buffer after that! */
+	for (unsigned int i = 0; i < num_blocks; ++i)
+	{
+		dyplo::HardwareDMAFifo::Block *block = to_adder_left.dequeue();
+		fillBuffer((int*)block->data, test_pattern_seed, samples_per_block);
+		block->bytes_used = bytes_per_block;
+		to_adder_left.enqueue(block);
+	}
+	for (unsigned int i = 0; i < num_blocks; ++i)
+	{
+		dyplo::HardwareDMAFifo::Block *block = to_adder_right.dequeue();
+		fillBuffer((int*)block->data, -test_pattern_seed, samples_per_block);
+		block->bytes_used = bytes_per_block;
+		to_adder_right.enqueue(block);
+	}
+
+	/* Fetch the data. The dequeue operation will block until data
+	 * is ready to be retrieved. */
+	for (unsigned int b = 0; b < num_blocks; ++b)
+	{
+		dyplo::HardwareDMAFifo::Block *block = from_adder.dequeue();
+
+		if (!checkBuffer((const int*)block->data, samples_per_block))
+			return 2;
+
+		/* If more data were to be retrieved, the block can be
+		 * re-enqueued to the DMA driver. */
+		// block->bytes_used = bytes_per_block;
+		// from_adder.enqueue(block);
+	}
+
+	std::cerr << "OK: " << bytes_per_block * num_blocks << " bytes (" <<
+		samples_per_block * num_blocks << " samples) processed\n";
+	return 0;
 }
 
 int main(int argc, char** argv)
 {
+	const char *profile_file = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "P:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'P':
+				profile_file = optarg;
+				break;
+			default:
+				std::cerr << "usage: " << argv[0] << " [-P profile]\n";
+				return 1;
+		}
+	}
+
 	try
 	{
+		// Load the tuned DMA settings, if there are any
+		DmaProfile profile;
+		std::string profile_path = DmaProfile::path(profile_file);
+		if (profile.load(profile_path))
+			std::cerr << "Using DMA profile " << profile_path << "\n";
+
 		// Create objects for hardware control
 		dyplo::HardwareContext hardware;
 		dyplo::HardwareControl hwControl(hardware);
@@ -87,72 +168,7 @@ int main(int argc, char** argv)
 		to_adder_right.addRouteTo(joiningAdderId + (1 << 8));
 		from_adder.addRouteFrom(joiningAdderId);
 
-		/* Allocate buffers, because of the zero-copy system, the driver
-		 * will allocate them for us in DMA capable memory, and give us
-		 * direct access through a memory map. The library does all the
-		 * work for us. */
-		static const unsigned int samples_per_block = 4096;
-		static const unsigned int bytes_per_block = samples_per_block * sizeof(int);
-		static const unsigned int num_blocks = 2;
-		to_adder_left.reconfigure(dyplo::HardwareDMAFifo::MODE_COHERENT, bytes_per_block, num_blocks, false);
-		to_adder_right.reconfigure(dyplo::HardwareDMAFifo::MODE_COHERENT, bytes_per_block, num_blocks, false);
-		from_adder.reconfigure(dyplo::HardwareDMAFifo::MODE_COHERENT, bytes_per_block, num_blocks, true);
-
-		/* Prime the reader with empty blocks. Just dequeue all blocks
-		 * and enqueue them. */
-		for (unsigned int i = 0; i < num_blocks; ++i)
-		{
-			dyplo::HardwareDMAFifo::Block *block = from_adder.dequeue();
-			block->bytes_used = bytes_per_block;
-			from_adder.enqueue(block);
-		}
-
-		/* Start data transfer on the senders. To send data, first dequeue
-		 * a block from the DMA, fill it with data and set the "bytes_used"
-		 * member. Then enqueue it. Do not access the buffer after that! */
-		for (unsigned int i = 0; i < num_blocks; ++i)
-		{
-			dyplo::HardwareDMAFifo::Block *block = to_adder_left.dequeue();
-			fillBuffer((int*)block->data, i * 1000, samples_per_block);
-			block->bytes_used = bytes_per_block;
-			to_adder_left.enqueue(block);
-		}
-		for (unsigned int i = 0; i < num_blocks; ++i)
-		{
-			dyplo::HardwareDMAFifo::Block *block = to_adder_right.dequeue();
-			fillBuffer((int*)block->data, i * (-1000), samples_per_block);
-			block->bytes_used = bytes_per_block;
-			to_adder_right.enqueue(block);
-		}
-
-		/* Fetch the data. The dequeue operation will block until data
-		 * is ready to be retrieved. */
-		for (unsigned int b = 0; b < num_blocks; ++b)
-		{
-			dyplo::HardwareDMAFifo::Block *block = from_adder.dequeue();
-
-			int *data = (int*)block->data;
-			// Compare the results to what we expect to get (basically, do
-			// the same calculation on the CPU)
-			for (unsigned int i = 0; i < samples_per_block; ++i)
-			{
-				if (data[i] != 2 * (int)i)
-				{
-					std::cerr << "Data mismatch at " << i <<
-						" Expected: " << 2*i <<
-						" Actual: " << data[i] <<
-						std::endl;
-					return 2;
-				}
-			}
-
-			/* If more data were to be retrieved, the block can be
-			 * re-enqueued to the DMA driver. */
-			// block->bytes_used = bytes_per_block;
-			// from_adder.enqueue(block);
-		}
-
-		std::cerr << "OK: " << bytes_per_block * num_blocks << " bytes processed\n";
+		return transfer(to_adder_left, to_adder_right, from_adder, profile);
 	}
 	catch (const std::exception& ex)
 	{
@@ -0,0 +1,404 @@
+/*
+ * loadgenerator.hpp
+ *
+ * Dyplo example application.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*  Open-loop load generation for the example pipelines.
+ *
+ *  Items are injected according to a schedule that does not depend on how
+ *  fast the pipeline accepts them. Each item is stamped with the time it
+ *  was *supposed* to be sent, so when the input queue blocks, the time
+ *  spent waiting shows up as latency instead of silently lowering the
+ *  offered load ("coordinated omission").
+ *
+ *  The pipeline keeps items in order, so the sink matches the n-th result
+ *  to the n-th intended send time. No timestamps need to travel through
+ *  the (possibly hardware) processing nodes.
+ */
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+static inline uint64_t monotonic_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void sleep_until_ns(uint64_t deadline)
+{
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+/* Log-linear histogram in the style of HdrHistogram. Values below
+ * 2^sub_bucket_bits are counted exactly, above that every power of two
+ * range is split into 2^sub_bucket_bits linear buckets, so the relative
+ * error stays below 1/2^sub_bucket_bits over the full 64-bit range. */
+class LatencyHistogram
+{
+	protected:
+		static const unsigned int sub_bucket_bits = 5;
+		static const unsigned int sub_bucket_count = 1 << sub_bucket_bits;
+
+		std::vector<uint64_t> counts;
+		uint64_t total;
+		uint64_t sum;
+		uint64_t min_value;
+		uint64_t max_value;
+
+		static unsigned int index_of(uint64_t value)
+		{
+			if (value < sub_bucket_count)
+				return (unsigned int)value;
+			unsigned int msb = 63 - __builtin_clzll(value);
+			unsigned int shift = msb - sub_bucket_bits;
+			return shift * sub_bucket_count + (unsigned int)(value >> shift);
+		}
+
+		/* Largest value that ends up in the same bucket */
+		static uint64_t highest_equivalent(unsigned int index)
+		{
+			if (index < 2 * sub_bucket_count)
+				return index;
+			unsigned int shift = index / sub_bucket_count - 1;
+			uint64_t mantissa = index - shift * sub_bucket_count;
+			return ((mantissa + 1) << shift) - 1;
+		}
+	public:
+		LatencyHistogram():
+			counts((65 - sub_bucket_bits) * sub_bucket_count, 0)
+		{
+			reset();
+		}
+
+		void reset()
+		{
+			std::fill(counts.begin(), counts.end(), 0);
+			total = 0;
+			sum = 0;
+			min_value = ~0ULL;
+			max_value = 0;
+		}
+
+		void record(uint64_t value)
+		{
+			++counts[index_of(value)];
+			++total;
+			sum += value;
+			if (value < min_value)
+				min_value = value;
+			if (value > max_value)
+				max_value = value;
+		}
+
+		uint64_t count() const { return total; }
+		uint64_t min() const { return total ? min_value : 0; }
+		uint64_t max() const { return max_value; }
+		uint64_t mean() const { return total ? sum / total : 0; }
+
+		uint64_t value_at_percentile(double percentile) const
+		{
+			if (total == 0)
+				return 0;
+			uint64_t wanted = (uint64_t)(percentile / 100.0 * total + 0.5);
+			if (wanted < 1)
+				wanted = 1;
+			uint64_t seen = 0;
+			for (unsigned int i = 0; i < counts.size(); ++i)
+			{
+				seen += counts[i];
+				if (seen >= wanted)
+				{
+					uint64_t value = highest_equivalent(i);
+					return value < max_value ? value : max_value;
+				}
+			}
+			return max_value;
+		}
+};
+
+/* When to send each item. All offsets are in nanoseconds relative to the
+ * start of the run. */
+class LoadSchedule
+{
+	public:
+		enum Mode { CONSTANT, BURSTY, REPLAY };
+	protected:
+		Mode mode;
+		double rate;
+		unsigned int burst;
+		std::vector<uint64_t> timestamps;
+	public:
+		/* Evenly spaced items at "rate" items per second */
+		static LoadSchedule constant(double rate)
+		{
+			return LoadSchedule(CONSTANT, rate, 1);
+		}
+
+		/* Groups of "burst" items sent back-to-back, the groups spaced so
+		 * that the average is "rate" items per second */
+		static LoadSchedule bursty(double rate, unsigned int burst)
+		{
+			return LoadSchedule(burst > 1 ? BURSTY : CONSTANT, rate, burst);
+		}
+
+		/* Send times from a file, one timestamp in microseconds per line.
+		 * Timestamps are taken relative to the first one. */
+		static LoadSchedule replay(const char* filename)
+		{
+			std::ifstream input(filename);
+			if (!input)
+				throw std::runtime_error(std::string("Cannot open replay file: ") + filename);
+			LoadSchedule result(REPLAY, 0, 1);
+			uint64_t first = 0;
+			uint64_t previous = 0;
+			double usec;
+			while (input >> usec)
+			{
+				uint64_t t = (uint64_t)(usec * 1000.0);
+				if (result.timestamps.empty())
+					first = t;
+				else if (t < previous)
+					throw std::runtime_error("Replay timestamps must not decrease");
+				previous = t;
+				result.timestamps.push_back(t - first);
+			}
+			if (!input.eof())
+				throw std::runtime_error(std::string("Invalid timestamp in replay file: ") + filename);
+			if (result.timestamps.empty())
+				throw std::runtime_error(std::string("Empty replay file: ") + filename);
+			if (previous > first)
+				result.rate = (result.timestamps.size() - 1) * 1e9 / (previous - first);
+			return result;
+		}
+
+		uint64_t offset(unsigned int index) const
+		{
+			switch (mode)
+			{
+				case BURSTY:
+					return (uint64_t)((index / burst) * (burst * 1e9 / rate));
+				case REPLAY:
+					/* Items that pad the recording to whole blocks
+					 * go out with the last one */
+					return timestamps[index < timestamps.size() ? index : timestamps.size() - 1];
+				default:
+					return (uint64_t)(index * (1e9 / rate));
+			}
+		}
+
+		/* Number of items in a schedule that lasts "seconds". A replayed
+		 * schedule always sends the whole recording. */
+		unsigned int items_for(double seconds) const
+		{
+			if (mode == REPLAY)
+				return timestamps.size();
+			unsigned int result = (unsigned int)(rate * seconds);
+			return result ? result : 1;
+		}
+
+		double offered_rate() const { return rate; }
+	private:
+		LoadSchedule(Mode m, double r, unsigned int b):
+			mode(m),
+			rate(r),
+			burst(b),
+			timestamps()
+		{
+		}
+};
+
+/* Connects the generator to the sink. The generator calls item_sent()
+ * with the intended send time, the sink calls item_received() for each
+ * result, in the same order. */
+class LatencyRecorder
+{
+	protected:
+		static const unsigned int ring_size = 1 << 16;
+
+		std::vector<uint64_t> intended;
+		uint64_t sent;
+		uint64_t received;
+		/* Results of an earlier measurement that had not arrived when it
+		 * ended. They are dropped instead of being matched to the send
+		 * times of the next one. */
+		uint64_t stale;
+		uint64_t last_received_at;
+		LatencyHistogram histogram;
+		pthread_mutex_t mutex;
+		pthread_cond_t condition;
+	public:
+		LatencyRecorder():
+			intended(ring_size),
+			sent(0),
+			received(0),
+			stale(0),
+			last_received_at(0),
+			histogram()
+		{
+			pthread_mutex_init(&mutex, NULL);
+			/* The completion timeout must not follow clock changes */
+			pthread_condattr_t attr;
+			pthread_condattr_init(&attr);
+			pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+			pthread_cond_init(&condition, &attr);
+			pthread_condattr_destroy(&attr);
+		}
+
+		~LatencyRecorder()
+		{
+			pthread_cond_destroy(&condition);
+			pthread_mutex_destroy(&mutex);
+		}
+
+		/* Start a new measurement. Items still in flight are written off. */
+		void reset()
+		{
+			pthread_mutex_lock(&mutex);
+			stale += sent - received;
+			received = sent;
+			histogram.reset();
+			last_received_at = 0;
+			pthread_mutex_unlock(&mutex);
+		}
+
+		void item_sent(uint64_t intended_time)
+		{
+			pthread_mutex_lock(&mutex);
+			/* The ring is far larger than what the queues can hold, this
+			 * only blocks if items get stuck in the pipeline. */
+			while (sent - received >= ring_size)
+				pthread_cond_wait(&condition, &mutex);
+			intended[sent % ring_size] = intended_time;
+			++sent;
+			pthread_mutex_unlock(&mutex);
+		}
+
+		void item_received()
+		{
+			uint64_t now = monotonic_ns();
+			pthread_mutex_lock(&mutex);
+			if (stale)
+			{
+				--stale;
+				pthread_mutex_unlock(&mutex);
+				return;
+			}
+			uint64_t t = intended[received % ring_size];
+			histogram.record(now > t ? now - t : 0);
+			++received;
+			last_received_at = now;
+			pthread_cond_broadcast(&condition);
+			pthread_mutex_unlock(&mutex);
+		}
+
+		/* Wait until all items sent have come out of the pipeline, or
+		 * until the timeout expires. Returns the number still in flight. */
+		uint64_t wait_for_completion(unsigned int timeout_ms)
+		{
+			struct timespec deadline;
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			deadline.tv_sec += timeout_ms / 1000;
+			deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+			if (deadline.tv_nsec >= 1000000000L)
+			{
+				deadline.tv_sec += 1;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			pthread_mutex_lock(&mutex);
+			while (received != sent)
+			{
+				if (pthread_cond_timedwait(&condition, &mutex, &deadline) == ETIMEDOUT)
+					break;
+			}
+			uint64_t result = sent - received;
+			pthread_mutex_unlock(&mutex);
+			return result;
+		}
+
+		/* Only valid after wait_for_completion() */
+		const LatencyHistogram& get_histogram() const { return histogram; }
+		uint64_t get_last_received_at() const { return last_received_at; }
+};
+
+/* Push "count" items into "queue" following "schedule". The value of each
+ * item is its sequence number, converted to the queue's element type. */
+template <class QueueClass>
+void run_load_step(QueueClass &queue, const LoadSchedule &schedule,
+	unsigned int count, LatencyRecorder &recorder, std::ostream &report)
+{
+	recorder.reset();
+	/* Leave some room to get the first item out on time */
+	uint64_t start = monotonic_ns() + 1000000;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		uint64_t intended_time = start + schedule.offset(i);
+		if (monotonic_ns() < intended_time)
+			sleep_until_ns(intended_time);
+		/* Stamp before pushing: If the push blocks, that counts. */
+		recorder.item_sent(intended_time);
+		queue.push_one((typename QueueClass::Element)i);
+	}
+	uint64_t lost = recorder.wait_for_completion(10000);
+	const LatencyHistogram &h = recorder.get_histogram();
+	/* Nothing arrived at all: no rate, and no valid "last received" */
+	uint64_t last = recorder.get_last_received_at();
+	uint64_t elapsed = (h.count() && last > start) ? last - start : 0;
+	double achieved = elapsed ? h.count() * 1e9 / elapsed : 0;
+	report << std::fixed << std::setprecision(1)
+		<< std::setw(12) << schedule.offered_rate()
+		<< std::setw(12) << achieved
+		<< std::setw(10) << h.count()
+		<< std::setw(10) << h.value_at_percentile(50.0) / 1000.0
+		<< std::setw(10) << h.value_at_percentile(90.0) / 1000.0
+		<< std::setw(10) << h.value_at_percentile(99.0) / 1000.0
+		<< std::setw(10) << h.value_at_percentile(99.9) / 1000.0
+		<< std::setw(10) << h.max() / 1000.0;
+	if (lost)
+		report << "  (" << lost << " items did not arrive)";
+	report << std::endl;
+}
+
+static inline void print_load_header(std::ostream &report)
+{
+	report << "#  offered/s  achieved/s     count    p50 us    p90 us    p99 us  p99.9 us    max us" << std::endl;
+}
@@ -0,0 +1,565 @@
+/*
+ * socketserver.hpp
+ *
+ * Dyplo example application.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*  UNIX-domain socket front end for a pipeline.
+ *
+ *  Clients connect to the socket and write samples as raw binary values
+ *  in native byte order. One I/O thread (the one calling run()) serves all
+ *  clients with epoll, reads their data in batches and pushes it into the
+ *  pipeline's input queue. The pipeline keeps items in order, so each
+ *  result is routed back to the client that sent the input, over the same
+ *  connection. A client may shut down its sending side and keep reading
+ *  until all its results have arrived.
+ *
+ *  Each client can have at most "max_pending" samples in the pipeline or
+ *  waiting to be sent back. A client that doesn't read its results stops
+ *  being read from, so its own writes block, without holding up the other
+ *  clients.
+ */
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+template <class T> class SocketIngestServer
+{
+	protected:
+		struct Client
+		{
+			int fd;
+			unsigned int events;
+			/* Incomplete sample from the last read */
+			char partial[sizeof(T)];
+			unsigned int partial_bytes;
+			/* Results waiting to be sent, of which the first
+			 * "results_sent" bytes were already sent */
+			std::vector<T> results;
+			unsigned int results_sent;
+			unsigned int in_flight;
+			bool input_closed;
+			bool closed;
+			/* Listed in "dirty" */
+			bool in_dirty;
+
+			Client(int fd_):
+				fd(fd_),
+				events(EPOLLIN),
+				partial_bytes(0),
+				results(),
+				results_sent(0),
+				in_flight(0),
+				input_closed(false),
+				closed(false),
+				in_dirty(false)
+			{
+			}
+		};
+
+		static const unsigned int batch_size = 16384;
+
+		std::string path;
+		int listen_fd;
+		int epoll_fd;
+		int event_fd;
+		unsigned int max_pending;
+		/* False while out of file descriptors, see accept_clients() */
+		bool accepting;
+		volatile sig_atomic_t stopping;
+		std::vector<T> read_buffer;
+		/* Protects everything the display process touches: The routing,
+		 * the dirty list and the clients' in_flight, results, closed and
+		 * in_dirty members. */
+		pthread_mutex_t mutex;
+		/* Which client sent the items in the pipeline, in order */
+		std::deque<std::pair<Client*, unsigned int> > routing;
+		/* Clients that received results since the last flush */
+		std::vector<Client*> dirty;
+		std::vector<Client*> clients;
+		/* Closed clients. Only the I/O thread deletes them, once no more
+		 * results are on their way and the current batch of events (which
+		 * may still refer to them) has been handled. */
+		std::vector<Client*> closed_clients;
+	public:
+		SocketIngestServer():
+			path(),
+			listen_fd(-1),
+			epoll_fd(-1),
+			event_fd(-1),
+			max_pending(0),
+			accepting(true),
+			stopping(0),
+			read_buffer(batch_size)
+		{
+			pthread_mutex_init(&mutex, NULL);
+		}
+
+		~SocketIngestServer()
+		{
+			for (typename std::vector<Client*>::iterator it = clients.begin(); it != clients.end(); ++it)
+			{
+				::close((*it)->fd);
+				delete *it;
+			}
+			for (typename std::vector<Client*>::iterator it = closed_clients.begin(); it != closed_clients.end(); ++it)
+				delete *it;
+			if (event_fd != -1)
+				::close(event_fd);
+			if (epoll_fd != -1)
+				::close(epoll_fd);
+			if (listen_fd != -1)
+			{
+				::close(listen_fd);
+				remove_socket(path.c_str());
+			}
+			pthread_mutex_destroy(&mutex);
+		}
+
+		void listen(const char* socket_path, unsigned int max_pending_per_client)
+		{
+			struct sockaddr_un addr;
+			if (strlen(socket_path) >= sizeof(addr.sun_path))
+				throw std::runtime_error(std::string("Socket path too long: ") + socket_path);
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			strcpy(addr.sun_path, socket_path);
+			path = socket_path;
+			max_pending = max_pending_per_client ? max_pending_per_client : 1;
+
+			listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (listen_fd == -1)
+				throw_errno("socket");
+			/* Replace a stale socket, but never any other kind of file */
+			struct stat st;
+			if (lstat(socket_path, &st) == 0)
+			{
+				if (!S_ISSOCK(st.st_mode))
+					throw std::runtime_error(std::string(socket_path) + " exists and is not a socket");
+				if (unlink(socket_path) != 0)
+					throw_errno("unlink");
+			}
+			else if (errno != ENOENT)
+				throw_errno("lstat");
+			if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+				throw_errno("bind");
+			if (::listen(listen_fd, SOMAXCONN) != 0)
+				throw_errno("listen");
+			epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+			if (epoll_fd == -1)
+				throw_errno("epoll_create1");
+			event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (event_fd == -1)
+				throw_errno("eventfd");
+			watch(listen_fd, EPOLLIN, &listen_fd);
+			watch(event_fd, EPOLLIN, &event_fd);
+		}
+
+		/* Serve clients until stop() is called. Pushes into "input" from
+		 * the calling thread, which blocks when the pipeline is full. */
+		template <class InputQueueClass> void run(InputQueueClass &input)
+		{
+			struct epoll_event events[64];
+			while (!stopping)
+			{
+				int count = epoll_wait(epoll_fd, events, 64, -1);
+				if (count < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					throw_errno("epoll_wait");
+				}
+				for (int i = 0; i < count; ++i)
+				{
+					void *source = events[i].data.ptr;
+					if (source == &listen_fd)
+						accept_clients();
+					else if (source == &event_fd)
+						flush_dirty();
+					else
+						handle_client((Client*)source, events[i].events, input);
+				}
+				delete_closed_clients();
+			}
+		}
+
+		/* May be called from a signal handler */
+		void stop()
+		{
+			stopping = 1;
+			wake(event_fd);
+		}
+
+		/* Called by the display process for each pipeline result */
+		void result_ready(const T& value)
+		{
+			bool notify = false;
+			pthread_mutex_lock(&mutex);
+			if (!routing.empty())
+			{
+				Client *client = routing.front().first;
+				if (--routing.front().second == 0)
+					routing.pop_front();
+				--client->in_flight;
+				if (client->closed)
+				{
+					/* Let the I/O thread delete it */
+					notify = (client->in_flight == 0);
+				}
+				else
+				{
+					if (!client->in_dirty)
+					{
+						notify = dirty.empty();
+						dirty.push_back(client);
+						client->in_dirty = true;
+					}
+					client->results.push_back(value);
+				}
+			}
+			pthread_mutex_unlock(&mutex);
+			if (notify)
+				wake(event_fd);
+		}
+	private:
+		static void wake(int fd)
+		{
+			uint64_t one = 1;
+			ssize_t r = write(fd, &one, sizeof(one));
+			(void)r; /* Fails only if the counter is huge, then it's awake anyway */
+		}
+
+		static void remove_socket(const char* socket_path)
+		{
+			struct stat st;
+			if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+				unlink(socket_path);
+		}
+
+		static void throw_errno(const char* what)
+		{
+			throw std::runtime_error(std::string(what) + ": " + strerror(errno));
+		}
+
+		void watch(int fd, unsigned int events, void *data)
+		{
+			struct epoll_event ev;
+			ev.events = events;
+			ev.data.ptr = data;
+			if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+				throw_errno("epoll_ctl");
+		}
+
+		/* A connection that can't be accepted is refused, the clients
+		 * that are already connected carry on. Only errors that mean the
+		 * listening socket itself is broken end the server. */
+		void accept_clients()
+		{
+			for (;;)
+			{
+				int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (fd == -1)
+				{
+					switch (errno)
+					{
+						case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+						case EWOULDBLOCK:
+#endif
+						case EINTR:
+							return;
+						case ECONNABORTED:
+						case EPROTO:
+						case EPERM:
+							/* Only this connection failed */
+							continue;
+						case EMFILE:
+						case ENFILE:
+							/* The connection stays pending, so the
+							 * listening socket stays readable. Stop
+							 * watching it until a client closes. */
+							std::cerr << "accept4: " << strerror(errno) <<
+								", not accepting new clients until one disconnects" << std::endl;
+							set_accepting(false);
+							return;
+						case ENOBUFS:
+						case ENOMEM:
+							std::cerr << "accept4: " << strerror(errno) << std::endl;
+							return;
+						default:
+							throw_errno("accept4");
+					}
+				}
+				Client *client = new Client(fd);
+				struct epoll_event ev;
+				ev.events = client->events;
+				ev.data.ptr = client;
+				if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+				{
+					std::cerr << "epoll_ctl: " << strerror(errno) << std::endl;
+					::close(fd);
+					delete client;
+					continue;
+				}
+				pthread_mutex_lock(&mutex);
+				clients.push_back(client);
+				pthread_mutex_unlock(&mutex);
+			}
+		}
+
+		void set_accepting(bool enable)
+		{
+			if (enable == accepting)
+				return;
+			struct epoll_event ev;
+			ev.events = enable ? EPOLLIN : 0;
+			ev.data.ptr = &listen_fd;
+			if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &ev) != 0)
+				throw_errno("epoll_ctl");
+			accepting = enable;
+		}
+
+		template <class InputQueueClass>
+		void handle_client(Client *client, unsigned int events, InputQueueClass &input)
+		{
+			/* Stale event, closed earlier in this batch */
+			if (client->closed)
+				return;
+			if (events & (EPOLLERR | EPOLLHUP))
+			{
+				close_client(client);
+				return;
+			}
+			if (events & EPOLLOUT)
+			{
+				if (!flush(client))
+				{
+					close_client(client);
+					return;
+				}
+			}
+			if (events & EPOLLIN)
+			{
+				if (!receive(client, input))
+				{
+					close_client(client);
+					return;
+				}
+			}
+			update(client);
+		}
+
+		/* Read one batch from the client and push it into the pipeline.
+		 * Returns false on errors. */
+		template <class InputQueueClass>
+		bool receive(Client *client, InputQueueClass &input)
+		{
+			pthread_mutex_lock(&mutex);
+			unsigned int pending = client->in_flight + client->results.size();
+			pthread_mutex_unlock(&mutex);
+			if (pending >= max_pending)
+				return true; /* update() stops reading */
+
+			char *buffer = (char*)&read_buffer[0];
+			unsigned int room = (max_pending - pending) * sizeof(T);
+			if (room > read_buffer.size() * sizeof(T))
+				room = read_buffer.size() * sizeof(T);
+			memcpy(buffer, client->partial, client->partial_bytes);
+			ssize_t bytes = ::read(client->fd, buffer + client->partial_bytes, room - client->partial_bytes);
+			if (bytes < 0)
+				return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+			if (bytes == 0)
+			{
+				client->input_closed = true;
+				return true;
+			}
+			unsigned int total = client->partial_bytes + bytes;
+			unsigned int items = total / sizeof(T);
+			client->partial_bytes = total % sizeof(T);
+			memcpy(client->partial, buffer + items * sizeof(T), client->partial_bytes);
+			if (items == 0)
+				return true;
+
+			/* Register the route before the items can come out */
+			pthread_mutex_lock(&mutex);
+			if (!routing.empty() && routing.back().first == client)
+				routing.back().second += items;
+			else
+				routing.push_back(std::make_pair(client, items));
+			client->in_flight += items;
+			pthread_mutex_unlock(&mutex);
+
+			const T *src = &read_buffer[0];
+			while (items)
+			{
+				typename InputQueueClass::Element *dst;
+				unsigned int count = input.begin_write(dst, 1);
+				if (count > items)
+					count = items;
+				std::copy(src, src + count, dst);
+				input.end_write(count);
+				src += count;
+				items -= count;
+			}
+			return true;
+		}
+
+		/* Send pending results. Returns false on errors. */
+		bool flush(Client *client)
+		{
+			bool result = true;
+			pthread_mutex_lock(&mutex);
+			if (!client->results.empty())
+			{
+				const char *data = (const char*)&client->results[0];
+				unsigned int size = client->results.size() * sizeof(T);
+				ssize_t bytes = send(client->fd, data + client->results_sent,
+					size - client->results_sent, MSG_NOSIGNAL);
+				if (bytes < 0)
+					result = (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+				else
+				{
+					client->results_sent += bytes;
+					if (client->results_sent == size)
+					{
+						client->results.clear();
+						client->results_sent = 0;
+					}
+				}
+			}
+			pthread_mutex_unlock(&mutex);
+			return result;
+		}
+
+		void flush_dirty()
+		{
+			uint64_t counter;
+			ssize_t r = read(event_fd, &counter, sizeof(counter));
+			(void)r; /* Nothing to do if it was a spurious wakeup */
+			std::vector<Client*> work;
+			pthread_mutex_lock(&mutex);
+			work.swap(dirty);
+			for (typename std::vector<Client*>::iterator it = work.begin(); it != work.end(); ++it)
+				(*it)->in_dirty = false;
+			pthread_mutex_unlock(&mutex);
+			for (typename std::vector<Client*>::iterator it = work.begin(); it != work.end(); ++it)
+			{
+				if ((*it)->closed)
+					continue;
+				if (flush(*it))
+					update(*it);
+				else
+					close_client(*it);
+			}
+		}
+
+		/* Adjust what we wait for on this client, and close it when it
+		 * is finished. */
+		void update(Client *client)
+		{
+			pthread_mutex_lock(&mutex);
+			bool has_output = !client->results.empty();
+			unsigned int pending = client->in_flight + client->results.size();
+			bool finished = client->input_closed && (client->in_flight == 0) && !has_output;
+			pthread_mutex_unlock(&mutex);
+			if (finished)
+			{
+				close_client(client);
+				return;
+			}
+			unsigned int events = 0;
+			if (!client->input_closed && (pending < max_pending))
+				events |= EPOLLIN;
+			if (has_output)
+				events |= EPOLLOUT;
+			if (events != client->events)
+			{
+				struct epoll_event ev;
+				ev.events = events;
+				ev.data.ptr = client;
+				epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+				client->events = events;
+			}
+		}
+
+		/* Results still in the pipeline for this client are dropped. The
+		 * client is deleted later, see delete_closed_clients(). */
+		void close_client(Client *client)
+		{
+			if (client->closed)
+				return;
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+			::close(client->fd);
+			/* A file descriptor is free again */
+			set_accepting(true);
+			pthread_mutex_lock(&mutex);
+			client->closed = true;
+			if (client->in_dirty)
+			{
+				dirty.erase(std::remove(dirty.begin(), dirty.end(), client), dirty.end());
+				client->in_dirty = false;
+			}
+			clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+			closed_clients.push_back(client);
+			pthread_mutex_unlock(&mutex);
+		}
+
+		/* Called between event batches, when no event refers to a closed
+		 * client anymore. Clients with results still in the pipeline are
+		 * kept, the display process wakes us when the last one arrives. */
+		void delete_closed_clients()
+		{
+			std::vector<Client*> unused;
+			pthread_mutex_lock(&mutex);
+			typename std::vector<Client*>::iterator keep = closed_clients.begin();
+			for (typename std::vector<Client*>::iterator it = closed_clients.begin(); it != closed_clients.end(); ++it)
+			{
+				if ((*it)->in_flight == 0)
+					unused.push_back(*it);
+				else
+					*keep++ = *it;
+			}
+			closed_clients.erase(keep, closed_clients.end());
+			pthread_mutex_unlock(&mutex);
+			for (typename std::vector<Client*>::iterator it = unused.begin(); it != unused.end(); ++it)
+				delete *it;
+		}
+};
@@ -0,0 +1,400 @@
+/*
+ * softwaredma.hpp
+ *
+ * Dyplo example application.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*  Software stand-ins for the DMA FIFOs and the joining_adder node, to run
+ *  the DMA calibration on a system without FPGA.
+ *
+ *  SoftwareFifo offers the copy-mode calls of dyplo::HardwareFifo (read,
+ *  write, setDataTreshold) and SoftwareDMAFifo the zero-copy calls of
+ *  dyplo::HardwareDMAFifo (reconfigure, dequeue, enqueue). The adder
+ *  threads play the part of the FPGA: They take data from the "device"
+ *  side of the FIFOs and hand back the sums of 32-bit words.
+ */
+#pragma once
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/types.h>
+#include <vector>
+#include <deque>
+#include <stdexcept>
+#include "dyplo/thread.hpp"
+#include "arithmetic.hpp"
+
+/* Like the driver's copy-mode buffer, a SoftwareFifo holds at most
+ * "capacity" bytes. A write waits for room, so a writer that gets ahead
+ * of the adder blocks here just as it would on the real hardware. */
+class SoftwareFifo
+{
+	protected:
+		std::vector<char> buffer;
+		size_t head;
+		size_t capacity;
+		unsigned int threshold;
+		bool interrupted;
+		pthread_mutex_t mutex;
+		pthread_cond_t data_available;
+		pthread_cond_t room_available;
+	public:
+		SoftwareFifo(size_t capacity_):
+			head(0),
+			capacity(capacity_),
+			threshold(sizeof(int)),
+			interrupted(false)
+		{
+			pthread_mutex_init(&mutex, NULL);
+			pthread_cond_init(&data_available, NULL);
+			pthread_cond_init(&room_available, NULL);
+		}
+
+		~SoftwareFifo()
+		{
+			pthread_cond_destroy(&room_available);
+			pthread_cond_destroy(&data_available);
+			pthread_mutex_destroy(&mutex);
+		}
+
+		/* Blocks until all data has been stored */
+		ssize_t write(const void *data, size_t bytes)
+		{
+			const char *src = (const char*)data;
+			size_t remaining = bytes;
+			pthread_mutex_lock(&mutex);
+			while (remaining)
+			{
+				while ((buffer.size() - head == capacity) && !interrupted)
+					pthread_cond_wait(&room_available, &mutex);
+				if (interrupted)
+				{
+					pthread_mutex_unlock(&mutex);
+					throw dyplo::InterruptedException();
+				}
+				size_t room = capacity - (buffer.size() - head);
+				size_t count = remaining < room ? remaining : room;
+				buffer.insert(buffer.end(), src, src + count);
+				src += count;
+				remaining -= count;
+				pthread_cond_signal(&data_available);
+			}
+			pthread_mutex_unlock(&mutex);
+			return bytes;
+		}
+
+		/* Blocks until "threshold" bytes (or all that was asked for)
+		 * are available. The threshold can't exceed the capacity. */
+		ssize_t read(void *data, size_t bytes)
+		{
+			pthread_mutex_lock(&mutex);
+			size_t wanted = bytes < threshold ? bytes : threshold;
+			if (wanted > capacity)
+				wanted = capacity;
+			while ((buffer.size() - head < wanted) && !interrupted)
+				pthread_cond_wait(&data_available, &mutex);
+			if (interrupted)
+			{
+				pthread_mutex_unlock(&mutex);
+				throw dyplo::InterruptedException();
+			}
+			size_t available = buffer.size() - head;
+			if (bytes > available)
+				bytes = available;
+			memcpy(data, &buffer[head], bytes);
+			head += bytes;
+			/* Compact once the consumed part dominates */
+			if (head == buffer.size())
+			{
+				buffer.clear();
+				head = 0;
+			}
+			else if (head > buffer.size() / 2)
+			{
+				buffer.erase(buffer.begin(), buffer.begin() + head);
+				head = 0;
+			}
+			pthread_cond_signal(&room_available);
+			pthread_mutex_unlock(&mutex);
+			return bytes;
+		}
+
+		void setDataTreshold(unsigned int bytes)
+		{
+			pthread_mutex_lock(&mutex);
+			threshold = bytes;
+			pthread_mutex_unlock(&mutex);
+		}
+
+		void interrupt()
+		{
+			pthread_mutex_lock(&mutex);
+			interrupted = true;
+			pthread_cond_broadcast(&data_available);
+			pthread_cond_broadcast(&room_available);
+			pthread_mutex_unlock(&mutex);
+		}
+};
+
+class SoftwareDMAFifo
+{
+	public:
+		enum Mode { MODE_STANDALONE, MODE_RINGBUFFER_BOUNCE, MODE_COHERENT, MODE_STREAMING };
+
+		struct Block
+		{
+			unsigned int id;
+			unsigned int offset;
+			unsigned int size;
+			unsigned int bytes_used;
+			unsigned int user_signal;
+			void* data;
+		};
+	protected:
+		std::vector<char> memory;
+		std::vector<Block> blocks;
+		/* Blocks owned by the application and by the "hardware" */
+		std::deque<Block*> to_app;
+		std::deque<Block*> to_device;
+		bool interrupted;
+		pthread_mutex_t mutex;
+		pthread_cond_t app_ready;
+		pthread_cond_t device_ready;
+	public:
+		SoftwareDMAFifo():
+			interrupted(false)
+		{
+			pthread_mutex_init(&mutex, NULL);
+			pthread_cond_init(&app_ready, NULL);
+			pthread_cond_init(&device_ready, NULL);
+		}
+
+		~SoftwareDMAFifo()
+		{
+			pthread_cond_destroy(&device_ready);
+			pthread_cond_destroy(&app_ready);
+			pthread_mutex_destroy(&mutex);
+		}
+
+		/* The memory mode makes no difference in software. All blocks
+		 * start out with the application, for both directions. */
+		void reconfigure(unsigned int mode, unsigned int size, unsigned int count, bool readonly)
+		{
+			pthread_mutex_lock(&mutex);
+			if (!to_device.empty())
+			{
+				pthread_mutex_unlock(&mutex);
+				throw std::logic_error("Cannot reconfigure with blocks in use");
+			}
+			memory.assign((size_t)size * count, 0);
+			blocks.resize(count);
+			to_app.clear();
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				Block &block = blocks[i];
+				block.id = i;
+				block.offset = i * size;
+				block.size = size;
+				block.bytes_used = 0;
+				block.user_signal = 0;
+				block.data = &memory[block.offset];
+				to_app.push_back(&block);
+			}
+			pthread_mutex_unlock(&mutex);
+		}
+
+		Block* dequeue()
+		{
+			return take(to_app, app_ready);
+		}
+
+		void enqueue(Block *block)
+		{
+			give(to_device, device_ready, block);
+		}
+
+		/* Called by the stand-in hardware */
+		Block* device_dequeue()
+		{
+			return take(to_device, device_ready);
+		}
+
+		void device_enqueue(Block *block)
+		{
+			give(to_app, app_ready, block);
+		}
+
+		void interrupt()
+		{
+			pthread_mutex_lock(&mutex);
+			interrupted = true;
+			pthread_cond_broadcast(&device_ready);
+			pthread_cond_broadcast(&app_ready);
+			pthread_mutex_unlock(&mutex);
+		}
+	private:
+		Block* take(std::deque<Block*> &list, pthread_cond_t &condition)
+		{
+			pthread_mutex_lock(&mutex);
+			while (list.empty() && !interrupted)
+				pthread_cond_wait(&condition, &mutex);
+			if (interrupted)
+			{
+				pthread_mutex_unlock(&mutex);
+				throw dyplo::InterruptedException();
+			}
+			Block *result = list.front();
+			list.pop_front();
+			pthread_mutex_unlock(&mutex);
+			return result;
+		}
+
+		void give(std::deque<Block*> &list, pthread_cond_t &condition, Block *block)
+		{
+			pthread_mutex_lock(&mutex);
+			list.push_back(block);
+			pthread_cond_signal(&condition);
+			pthread_mutex_unlock(&mutex);
+		}
+};
+
+/* Stand-in for the joining_adder node behind copy-mode FIFOs */
+class SoftwareCopyAdder
+{
+	protected:
+		SoftwareFifo &left;
+		SoftwareFifo &right;
+		SoftwareFifo &output;
+		dyplo::Thread m_thread;
+	public:
+		SoftwareCopyAdder(SoftwareFifo &left_, SoftwareFifo &right_, SoftwareFifo &output_):
+			left(left_),
+			right(right_),
+			output(output_),
+			m_thread()
+		{
+			m_thread.start(&run, this);
+		}
+
+		~SoftwareCopyAdder()
+		{
+			left.interrupt();
+			right.interrupt();
+			output.interrupt();
+			m_thread.join();
+		}
+
+		void* process()
+		{
+			static const unsigned int chunk = 16384;
+			std::vector<int> a(chunk);
+			std::vector<int> b(chunk);
+			std::vector<int> sum(chunk);
+			try
+			{
+				for (;;)
+				{
+					ssize_t bytes = left.read(&a[0], chunk * sizeof(int));
+					/* Take the same amount from the other input */
+					for (ssize_t done = 0; done < bytes; )
+						done += right.read((char*)&b[0] + done, bytes - done);
+					unsigned int count = bytes / sizeof(int);
+					add_block<WrappingArithmetic<int> >(&sum[0], &a[0], &b[0], count);
+					output.write(&sum[0], bytes);
+				}
+			}
+			catch (const dyplo::InterruptedException&)
+			{
+				//
+			}
+			return 0;
+		}
+	private:
+		static void* run(void* arg)
+		{
+			return ((SoftwareCopyAdder*)arg)->process();
+		}
+};
+
+/* Stand-in for the joining_adder node behind zero-copy FIFOs */
+class SoftwareZeroCopyAdder
+{
+	protected:
+		SoftwareDMAFifo &left;
+		SoftwareDMAFifo &right;
+		SoftwareDMAFifo &output;
+		dyplo::Thread m_thread;
+	public:
+		SoftwareZeroCopyAdder(SoftwareDMAFifo &left_, SoftwareDMAFifo &right_, SoftwareDMAFifo &output_):
+			left(left_),
+			right(right_),
+			output(output_),
+			m_thread()
+		{
+			m_thread.start(&run, this);
+		}
+
+		~SoftwareZeroCopyAdder()
+		{
+			left.interrupt();
+			right.interrupt();
+			output.interrupt();
+			m_thread.join();
+		}
+
+		void* process()
+		{
+			try
+			{
+				for (;;)
+				{
+					SoftwareDMAFifo::Block *a = left.device_dequeue();
+					SoftwareDMAFifo::Block *b = right.device_dequeue();
+					SoftwareDMAFifo::Block *result = output.device_dequeue();
+					unsigned int bytes = a->bytes_used;
+					if (bytes > b->bytes_used)
+						bytes = b->bytes_used;
+					if (bytes > result->size)
+						bytes = result->size;
+					add_block<WrappingArithmetic<int> >((int*)result->data,
+						(const int*)a->data, (const int*)b->data, bytes / sizeof(int));
+					result->bytes_used = bytes;
+					left.device_enqueue(a);
+					right.device_enqueue(b);
+					output.device_enqueue(result);
+				}
+			}
+			catch (const dyplo::InterruptedException&)
+			{
+				//
+			}
+			return 0;
+		}
+	private:
+		static void* run(void* arg)
+		{
+			return ((SoftwareZeroCopyAdder*)arg)->process();
+		}
+};
@@ -29,6 +29,7 @@
 #include "dyplo/cooperativescheduler.hpp"
 #include "dyplo/cooperativeprocess.hpp"
 #include "dyplo/thread.hpp"
+#include "arithmetic.hpp"
 
 template <class InputQueueClass,
 		void(*ProcessItemFunction)(typename InputQueueClass::Element*),
@@ -188,9 +189,12 @@ template <class InputQueueClass,
 		}
 };
 
+/* Adds the left and right inputs. The Arithmetic policy (see
+ * arithmetic.hpp) selects wrapping or saturating addition. */
 template <class InputQueueClassLeft, class InputQueueClassRight,
 	class OutputQueueClass,
-	int blocksize=1>
+	int blocksize=1,
+	class Arithmetic = WrappingArithmetic<typename OutputQueueClass::Element> >
 	class JoiningAddProcess
 {
 	protected:
@@ -244,8 +248,7 @@ template <class InputQueueClassLeft, class InputQueueClassRight,
 				input_right->begin_read(src_right, blocksize);
 				typename OutputQueueClass::Element *dst;
 				output->begin_write(dst, blocksize);
-				for (int i=0; i<blocksize; ++i)
-					dst[i] = src_left[i] + src_right[i];
+				add_block<Arithmetic>(dst, src_left, src_right, blocksize);
 				output->end_write(blocksize);
 				input_right->end_read(blocksize);
 				input_left->end_read(blocksize);
@@ -0,0 +1,323 @@
+/*
+ * spliceforwarder.hpp
+ *
+ * Dyplo example application.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*  Zero-copy replacement for the Tee node, for raw binary input.
+ *
+ *  Data is duplicated in the kernel with tee(2) and moved to the two
+ *  outputs with splice(2), so it never passes through user space. The
+ *  input can be a pipe or a regular file (which is spliced into a pipe
+ *  first). The outputs can be any file descriptor: a Dyplo FIFO, a pipe
+ *  or a regular file. An output that does not support splice falls back
+ *  to a read/write copy.
+ *
+ *  Both outputs are serviced in turn without blocking, so a downstream
+ *  node that waits for the other branch cannot stall the forwarding.
+ */
+#pragma once
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+class SpliceForwarder
+{
+	protected:
+		struct Output
+		{
+			int fd;
+			int saved_flags;
+			/* Pipe to take the data from, and how much to take */
+			int source;
+			size_t remaining;
+			/* Copy fallback for outputs that cannot splice */
+			bool use_copy;
+			std::vector<char> buffer;
+			size_t buffer_offset;
+			size_t buffer_size;
+		};
+
+		int input;
+		bool input_is_pipe;
+		bool input_eof;
+		int feed_pipe[2];
+		int copy_pipe[2];
+		size_t chunk;
+		size_t granularity;
+		Output outputs[2];
+	public:
+		/* "granularity" is the sample size, outputs only ever receive
+		 * whole samples (except for a trailing partial one at the end of
+		 * the input). */
+		SpliceForwarder(int input_fd, int left_fd, int right_fd, size_t granularity_ = sizeof(int)):
+			input(input_fd),
+			input_is_pipe(false),
+			input_eof(false),
+			chunk(0),
+			granularity(granularity_)
+		{
+			feed_pipe[0] = feed_pipe[1] = -1;
+			copy_pipe[0] = copy_pipe[1] = -1;
+			struct stat st;
+			if (fstat(input, &st) != 0)
+				throw_errno("fstat");
+			input_is_pipe = S_ISFIFO(st.st_mode);
+			if (!input_is_pipe && pipe(feed_pipe) != 0)
+				throw_errno("pipe");
+			if (pipe(copy_pipe) != 0)
+				throw_errno("pipe");
+			int size = fcntl(copy_pipe[1], F_GETPIPE_SZ);
+			chunk = (size > 0) ? size : 65536;
+			chunk -= chunk % granularity;
+			init_output(outputs[0], left_fd, input_is_pipe ? input : feed_pipe[0]);
+			init_output(outputs[1], right_fd, copy_pipe[0]);
+		}
+
+		~SpliceForwarder()
+		{
+			for (int i = 0; i < 2; ++i)
+				fcntl(outputs[i].fd, F_SETFL, outputs[i].saved_flags);
+			for (int i = 0; i < 2; ++i)
+			{
+				if (feed_pipe[i] != -1)
+					::close(feed_pipe[i]);
+				if (copy_pipe[i] != -1)
+					::close(copy_pipe[i]);
+			}
+		}
+
+		/* Forward until the end of the input. Returns the number of bytes
+		 * forwarded to each output. */
+		unsigned long long run()
+		{
+			unsigned long long total = 0;
+			int source = outputs[0].source;
+			for (;;)
+			{
+				if (!input_is_pipe)
+					feed();
+				ssize_t bytes = tee(source, copy_pipe[1], chunk, 0);
+				if (bytes < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					throw_errno("tee");
+				}
+				if (bytes == 0)
+					break;
+				size_t amount = bytes - (bytes % granularity);
+				if (amount == 0)
+				{
+					/* Less than one sample available. Forward it only if
+					 * no more data will follow. */
+					if (!at_end(source))
+					{
+						wait_a_bit();
+						/* Drop the duplicate, tee() will make a new one */
+						discard(copy_pipe[0], bytes);
+						continue;
+					}
+					amount = bytes;
+				}
+				outputs[0].remaining = amount;
+				outputs[1].remaining = amount;
+				transfer();
+				/* Drop the duplicated partial sample, it will be in the
+				 * next tee() again */
+				if (amount < (size_t)bytes)
+					discard(copy_pipe[0], bytes - amount);
+				total += amount;
+			}
+			return total;
+		}
+	private:
+		static void throw_errno(const char* what)
+		{
+			throw std::runtime_error(std::string(what) + ": " + strerror(errno));
+		}
+
+		void init_output(Output &output, int fd, int source)
+		{
+			output.fd = fd;
+			output.saved_flags = fcntl(fd, F_GETFL);
+			if (output.saved_flags == -1)
+				throw_errno("fcntl");
+			fcntl(fd, F_SETFL, output.saved_flags | O_NONBLOCK);
+			output.source = source;
+			output.remaining = 0;
+			output.use_copy = false;
+			output.buffer_offset = 0;
+			output.buffer_size = 0;
+		}
+
+		/* Move a chunk from a non-pipe input into the feed pipe */
+		void feed()
+		{
+			if (input_eof)
+				return;
+			ssize_t bytes;
+			do
+				bytes = splice(input, NULL, feed_pipe[1], NULL, chunk, SPLICE_F_MOVE);
+			while (bytes < 0 && errno == EINTR);
+			if (bytes < 0)
+				throw_errno("splice");
+			if (bytes == 0)
+			{
+				input_eof = true;
+				::close(feed_pipe[1]);
+				feed_pipe[1] = -1;
+			}
+		}
+
+		/* True when the writing end of the pipe has been closed */
+		bool at_end(int fd)
+		{
+			if (!input_is_pipe)
+				return input_eof;
+			struct pollfd p;
+			p.fd = fd;
+			p.events = POLLIN;
+			return (poll(&p, 1, 0) > 0) && (p.revents & POLLHUP);
+		}
+
+		static void wait_a_bit()
+		{
+			struct timespec ts = { 0, 100000 };
+			nanosleep(&ts, NULL);
+		}
+
+		void discard(int fd, size_t bytes)
+		{
+			char buffer[256];
+			while (bytes)
+			{
+				ssize_t r = ::read(fd, buffer, bytes < sizeof(buffer) ? bytes : sizeof(buffer));
+				if (r <= 0)
+				{
+					if (r < 0 && errno == EINTR)
+						continue;
+					throw_errno("read");
+				}
+				bytes -= r;
+			}
+		}
+
+		/* Deliver "remaining" bytes to both outputs, whichever can take
+		 * data first. */
+		void transfer()
+		{
+			for (;;)
+			{
+				bool busy = false;
+				bool progress = false;
+				for (int i = 0; i < 2; ++i)
+				{
+					Output &output = outputs[i];
+					if (output.remaining == 0 && output.buffer_size == 0)
+						continue;
+					busy = true;
+					if (step(output))
+						progress = true;
+				}
+				if (!busy)
+					return;
+				if (!progress)
+					wait_writable();
+			}
+		}
+
+		/* Returns true if any data was moved */
+		bool step(Output &output)
+		{
+			if (!output.use_copy)
+			{
+				ssize_t bytes = splice(output.source, NULL, output.fd, NULL,
+					output.remaining, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+				if (bytes > 0)
+				{
+					output.remaining -= bytes;
+					return true;
+				}
+				if (bytes == 0 || errno == EAGAIN || errno == EINTR)
+					return false;
+				if (errno != EINVAL)
+					throw_errno("splice");
+				/* The output doesn't support splice */
+				output.use_copy = true;
+				output.buffer.resize(chunk);
+			}
+			if (output.buffer_size == 0)
+			{
+				ssize_t bytes = ::read(output.source, &output.buffer[0], output.remaining);
+				if (bytes <= 0)
+				{
+					if (bytes < 0 && errno == EINTR)
+						return false;
+					throw_errno("read");
+				}
+				output.remaining -= bytes;
+				output.buffer_offset = 0;
+				output.buffer_size = bytes;
+			}
+			ssize_t bytes = ::write(output.fd, &output.buffer[output.buffer_offset], output.buffer_size);
+			if (bytes < 0)
+			{
+				if (errno == EAGAIN || errno == EINTR)
+					return false;
+				throw_errno("write");
+			}
+			output.buffer_offset += bytes;
+			output.buffer_size -= bytes;
+			return bytes > 0;
+		}
+
+		void wait_writable()
+		{
+			struct pollfd p[2];
+			nfds_t count = 0;
+			for (int i = 0; i < 2; ++i)
+			{
+				if (outputs[i].remaining == 0 && outputs[i].buffer_size == 0)
+					continue;
+				p[count].fd = outputs[i].fd;
+				p[count].events = POLLOUT;
+				++count;
+			}
+			if (poll(p, count, -1) < 0 && errno != EINTR)
+				throw_errno("poll");
+		}
+};
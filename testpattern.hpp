@@ -0,0 +1,80 @@
+/*
+ * testpattern.hpp
+ *
+ * Dyplo example application.
+ *
+ * (C) Copyright 2026 Topic Embedded Products B.V. (http://www.topic.nl).
+ * All rights reserved.
+ *
+ * This file is part of dyplo-example-app.
+ * dyplo-example-app is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dyplo-example-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Dyplo.  If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA or see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact Topic by electronic mail via info@topic.nl or via
+ * paper mail at the following address: Postbus 440, 5680 AK Best, The Netherlands.
+ */
+
+/*  Test data and helpers for the DMA examples. The left input of the
+ *  joining_adder gets seed, seed+1, ... and the right input -seed,
+ *  -seed+1, ..., so the n-th result is 2*n. The node adds 32-bit words, so
+ *  the samples are 32-bit as well.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <iostream>
+#include <stdexcept>
+
+static const int test_pattern_seed = 1000;
+
+// Fill a buffer with numbers seed, seed+1, ..., seed+count-1
+static inline void fillBuffer(int* buffer, int seed, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+		buffer[i] = seed + i;
+}
+
+// Compare the results to what we expect to get (basically, do
+// the same calculation on the CPU)
+static inline bool checkBuffer(const int* data, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		if (data[i] != 2 * (int)i)
+		{
+			std::cerr << "Data mismatch at " << i <<
+				" Expected: " << 2*i <<
+				" Actual: " << data[i] <<
+				std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Read exactly "bytes" from a copy-mode DMA FIFO. A read may return less
+// than asked for when the data threshold is below the block size.
+template <class Fifo> static void readFully(Fifo &fifo, void *data, unsigned int bytes)
+{
+	char *dest = (char*)data;
+	while (bytes)
+	{
+		ssize_t r = fifo.read(dest, bytes);
+		if (r <= 0)
+			throw std::runtime_error("Failed to read from DMA");
+		dest += r;
+		bytes -= r;
+	}
+}